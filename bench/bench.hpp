@@ -0,0 +1,50 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Tiny std::chrono harness behind 'falcon_bench'. Each case registers itself with FC_BENCHMARK
+// and reports its own measurements, 'falcon_bench <filter>' only runs the cases whose name
+// contains <filter>.
+namespace fc::bench {
+
+using case_fn = void (*)();
+
+inline std::vector<std::pair<const char *, case_fn>> &cases() {
+  static std::vector<std::pair<const char *, case_fn>> all;
+  return all;
+}
+
+inline bool add_case(const char *name, case_fn fn) {
+  cases().emplace_back(name, fn);
+  return true;
+}
+
+// keeps the compiler from dropping a computation whose result is otherwise unused
+template <typename T> inline void do_not_optimize(const T &value) { asm volatile("" : : "r,m"(value) : "memory"); }
+
+// Calls 'fn' in batches doubling in size until one batch ran for at least 'min_time', returns
+// the mean time of a call in nanoseconds
+template <typename Fn> double measure(Fn &&fn, std::chrono::nanoseconds min_time = std::chrono::milliseconds(200)) {
+  for (uint64_t iters = 1;; iters *= 2) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iters; i++) fn();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    if (elapsed >= min_time) return std::chrono::duration<double, std::nano>(elapsed).count() / iters;
+  }
+}
+
+inline void report(std::string_view name, double ns_per_op) {
+  std::printf("%-48.*s %12.1f ns/op\n", (int)name.size(), name.data(), ns_per_op);
+}
+
+} // namespace fc::bench
+
+#define FC_BENCHMARK(fn)                                                  \
+  static void fn();                                                       \
+  static const bool fn##_registered = fc::bench::add_case(#fn, fn);       \
+  static void fn()
@@ -0,0 +1,52 @@
+#include <cstring>
+#include <string>
+
+#include "bench.hpp"
+#include "include/fc.hpp"
+#include "src/arena.hpp"
+#include "src/http.hpp"
+#include "src/pool.hpp"
+#include "src/req.hpp"
+#include "src/utils.hpp"
+
+namespace {
+
+const char RAW_GET[] = "GET /users HTTP/1.1\r\n"
+                       "Host: localhost:8000\r\n"
+                       "Cookie: session=8f14e45fceea167a5a36dedd4bea2543; theme=dark; lang=en-US; _ga=GA1.1.1234567890.1700000000\r\n"
+                       "\r\n";
+
+} // namespace
+
+// first 'request::get_cookie' parses the header, the next ones only look the name up
+FC_BENCHMARK(cookies) {
+  fc::buffer_pool pool(1024 * 16, 4);
+  fc::arena arena(&pool);
+  fc::http_parser parser(1024 * 16, 1024 * 1024);
+  double parse = fc::bench::measure([&] {
+    fc::request req = fc::request_factory(nullptr, {}, &arena);
+    size_t nparsed = 0;
+    parser.execute(&req, RAW_GET, strlen(RAW_GET), &nparsed);
+    arena.reset();
+  });
+  fc::bench::report("parse + first lookup", fc::bench::measure([&] {
+                      fc::request req = fc::request_factory(nullptr, {}, &arena);
+                      size_t nparsed = 0;
+                      parser.execute(&req, RAW_GET, strlen(RAW_GET), &nparsed);
+                      fc::bench::do_not_optimize(req.get_cookie("lang"));
+                      arena.reset();
+                    }) - parse);
+
+  fc::request req = fc::request_factory(nullptr, {}, &arena);
+  size_t nparsed = 0;
+  parser.execute(&req, RAW_GET, strlen(RAW_GET), &nparsed);
+  req.get_cookie("session");
+  fc::bench::report("lookup", fc::bench::measure([&] { fc::bench::do_not_optimize(req.get_cookie("lang")); }));
+}
+
+FC_BENCHMARK(split_address) {
+  for (const char *addr : {":8000", "127.0.0.1:8000", "localhost:65535"}) {
+    std::string input = addr;
+    fc::bench::report(addr, fc::bench::measure([&] { fc::bench::do_not_optimize(split_address(input)); }));
+  }
+}
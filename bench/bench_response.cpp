@@ -0,0 +1,56 @@
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "external/nlohmann/json.hpp"
+#include "include/fc.hpp"
+
+namespace {
+
+nlohmann::json make_users(size_t n) {
+  nlohmann::json json = nlohmann::json::object();
+  for (size_t i = 0; i < n; i++) {
+    json["users"].push_back({{"id", i}, {"email", "user" + std::to_string(i) + "@email.com"}, {"password", "secret"}});
+  }
+  return json;
+}
+
+} // namespace
+
+// 'response::json' for a small object and for lists of users, then the head the worker writes
+FC_BENCHMARK(response_json) {
+  nlohmann::json small = {{"email", "alicey@email.com"}, {"password", "alice123"}};
+  fc::bench::report("json/object", fc::bench::measure([&] { fc::bench::do_not_optimize(fc::response::json(small)); }));
+  for (size_t n : {10, 100}) {
+    nlohmann::json users = make_users(n);
+    fc::bench::report("json/users/" + std::to_string(n), fc::bench::measure([&] { fc::bench::do_not_optimize(fc::response::json(users)); }));
+  }
+  fc::bench::report("ok", fc::bench::measure([] { fc::bench::do_not_optimize(fc::response::ok()); }));
+}
+
+// a list answered from plain structs: built as a tree then serialized, or written as it goes
+FC_BENCHMARK(response_json_list) {
+  struct user {
+    size_t m_id;
+    std::string m_email;
+  };
+  for (size_t n : {100, 10000}) {
+    std::vector<user> users;
+    for (size_t i = 0; i < n; i++) users.push_back({i, "user" + std::to_string(i) + "@email.com"});
+    fc::bench::report("tree/" + std::to_string(n), fc::bench::measure([&] {
+      nlohmann::json json = nlohmann::json::array();
+      for (auto &u : users) json.push_back({{"id", u.m_id}, {"email", u.m_email}});
+      fc::bench::do_not_optimize(fc::response::json(json));
+    }));
+    fc::bench::report("writer/" + std::to_string(n), fc::bench::measure([&] {
+      fc::response res = fc::response::ok();
+      {
+        fc::json_writer w(res);
+        w.begin_array();
+        for (auto &u : users) w.begin_object().key("id").value(u.m_id).key("email").value(u.m_email).end_object();
+        w.end_array();
+      }
+      fc::bench::do_not_optimize(res);
+    }));
+  }
+}
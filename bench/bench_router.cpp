@@ -0,0 +1,150 @@
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "include/fc.hpp"
+#include "src/arena.hpp"
+#include "src/http.hpp"
+#include "src/pool.hpp"
+#include "src/req.hpp"
+#include "src/router.hpp"
+
+namespace {
+
+// The router as it was before the radix tree, a tree of segments whose children are a linked
+// list scanned in order. Kept here as the baseline.
+struct list_frag {
+  enum type { STATIC, DYNAMIC, WILDCARD } m_type;
+  std::string m_label;
+  fc::frag_handlers_t *m_handlers = nullptr;
+  list_frag *m_next = nullptr;
+  list_frag *m_child = nullptr;
+
+  list_frag(type type, std::string label) : m_type(type), m_label(std::move(label)) {}
+  ~list_frag() {
+    delete m_handlers;
+    delete m_child;
+    delete m_next;
+  }
+};
+
+struct list_router {
+  list_frag m_root{list_frag::STATIC, ""};
+
+  void add(fc::method method, const std::string &path, fc::path_handler handler) {
+    list_frag *current = &m_root;
+    std::string_view rest = path, frg;
+    while (fc::next_segment(rest, frg)) {
+      list_frag::type type = frg[0] == ':' ? list_frag::DYNAMIC : frg[0] == '*' ? list_frag::WILDCARD : list_frag::STATIC;
+      list_frag *prev = nullptr, *child = current->m_child;
+      while (child) {
+        if ((type == list_frag::STATIC && child->m_label == frg) || (type != list_frag::STATIC && child->m_type == type)) break;
+        prev = child;
+        child = child->m_next;
+      }
+      if (!child) {
+        child = new list_frag(type, std::string(type == list_frag::DYNAMIC ? frg.substr(1) : frg));
+        (prev ? prev->m_next : current->m_child) = child;
+      }
+      current = child;
+    }
+    if (!current->m_handlers) current->m_handlers = new fc::frag_handlers_t();
+    current->m_handlers->at((int)method).push_back(handler);
+  }
+
+  const fc::frag_handlers_t *find(std::string_view path, fc::route_params &params) const {
+    const list_frag *current = &m_root;
+    std::string_view frg;
+    while (fc::next_segment(path, frg)) {
+      const list_frag *child = current->m_child;
+      while (child) {
+        if (list_frag::STATIC == child->m_type && frg == child->m_label) break;
+        if (list_frag::DYNAMIC == child->m_type) {
+          params.emplace_back(child->m_label, frg);
+          break;
+        }
+        if (list_frag::WILDCARD == child->m_type) {
+          path = {};
+          break;
+        }
+        child = child->m_next;
+      }
+      if (!child) return nullptr;
+      current = child;
+    }
+    return current->m_handlers;
+  }
+};
+
+fc::response noop(fc::request &) { return fc::response::ok(); }
+
+// 'nroutes' routes spread under /api/v1, half static and half with a dynamic id, plus the
+// request paths hitting them
+void make_routes(size_t nroutes, std::vector<std::string> &routes, std::vector<std::string> &paths) {
+  for (size_t i = 0; i < nroutes; i++) {
+    std::string base = "/api/v1/resource" + std::to_string(i / 2);
+    routes.push_back(i % 2 ? base + "/:id" : base);
+    paths.push_back(i % 2 ? base + "/" + std::to_string(i) : base);
+  }
+}
+
+template <typename Router> void run_lookups(const char *name, const Router &router, const std::vector<std::string> &paths) {
+  std::pmr::unsynchronized_pool_resource mr;
+  fc::route_params params(&mr);
+  params.reserve(8);
+  size_t next = 0, step = paths.size() / 7 + 1;
+  fc::bench::report(name, fc::bench::measure([&] {
+                      params.clear();
+                      fc::bench::do_not_optimize(router.find(paths[next], params));
+                      next = (next + step) % paths.size();
+                    }));
+}
+
+void bench_lookup(size_t nroutes) {
+  std::vector<std::string> routes, paths;
+  make_routes(nroutes, routes, paths);
+
+  list_router list;
+  fc::root_router radix;
+  for (auto &route : routes) {
+    list.add(fc::method::GET, route, noop);
+    radix.add(fc::method::GET, route, noop, {});
+  }
+  std::string suffix = "/" + std::to_string(nroutes);
+  run_lookups(("linked list" + suffix).c_str(), list, paths);
+  run_lookups(("radix tree" + suffix).c_str(), radix, paths);
+}
+
+} // namespace
+
+FC_BENCHMARK(router_lookup) {
+  for (size_t nroutes : {10, 100, 10000}) bench_lookup(nroutes);
+}
+
+// 'root_router::match' as the worker calls it: canonical path, lookup and params in the arena.
+// match fills the request so each run parses a fresh one, the parse alone is timed and subtracted.
+FC_BENCHMARK(router_match) {
+  std::vector<std::string> routes, paths;
+  make_routes(100, routes, paths);
+  fc::root_router router;
+  for (auto &route : routes) router.add(fc::method::GET, route, noop, {});
+
+  fc::buffer_pool pool(1024 * 16, 4);
+  fc::arena arena(&pool);
+  fc::http_parser parser(1024 * 16, 1024 * 1024);
+  for (const char *path : {"/api/v1/resource7", "/api/v1/resource7/15", "//api/v1/resource7/15/?q=1"}) {
+    std::string raw = std::string("GET ") + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    auto run = [&](bool match) {
+      return fc::bench::measure([&] {
+        fc::request req = fc::request_factory(nullptr, {}, &arena);
+        size_t nparsed = 0;
+        parser.execute(&req, raw.data(), raw.size(), &nparsed);
+        if (match) fc::bench::do_not_optimize(router.match(req));
+        arena.reset();
+      });
+    };
+    double parse = run(false);
+    fc::bench::report(path, run(true) - parse);
+  }
+}
@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <uv.h>
+#include <vector>
+
+#include "external/llhttp/llhttp.h"
+
+// HTTP/1.1 load generator in the spirit of wrk: every thread runs its own libuv loop driving a
+// share of the keep-alive connections, each with one request in flight. Latency is taken from
+// the request write to the end of its response and reported as percentiles once all threads
+// are done.
+//
+//   falcon_load [-t threads] [-c connections] [-d seconds] [-H 'Name: value']... http://host:port/path
+
+namespace {
+
+struct options {
+  unsigned m_threads = 2;
+  unsigned m_connections = 64;
+  unsigned m_seconds = 10;
+  std::string m_host = "127.0.0.1";
+  int m_port = 8000;
+  std::string m_path = "/";
+  std::vector<std::string> m_headers;
+};
+
+struct load_thread;
+
+struct client {
+  // must stay the first member, libuv callbacks hand us a 'uv_tcp_t *' which is cast back
+  uv_tcp_t m_handle;
+  uv_connect_t m_connect;
+  uv_write_t m_write;
+  llhttp_t m_parser;
+  load_thread *m_thread;
+  uint64_t m_sent_at;
+  bool m_keep_alive;
+  char m_buf[1024 * 64];
+};
+
+struct load_thread {
+  uv_loop_t m_loop;
+  uv_timer_t m_stop_timer;
+  const options *m_options;
+  const sockaddr_in *m_addr;
+  uv_buf_t m_request;
+  std::vector<client *> m_clients;
+  std::vector<uint64_t> m_latencies; // ns
+  uint64_t m_bytes = 0;
+  uint64_t m_connect_errors = 0;
+  uint64_t m_read_errors = 0;
+  uint64_t m_non_2xx = 0;
+  bool m_stopping = false;
+};
+
+void connect_client(client *c);
+void send_request(client *c);
+void stop(load_thread *t);
+
+int on_message_complete(llhttp_t *p) {
+  client *c = (client *)p->data;
+  load_thread *t = c->m_thread;
+  t->m_latencies.push_back(uv_hrtime() - c->m_sent_at);
+  if (p->status_code < 200 || p->status_code > 299) t->m_non_2xx++;
+  c->m_keep_alive = llhttp_should_keep_alive(p);
+  // one request in flight, the next one is sent once this response was read whole
+  return HPE_PAUSED;
+}
+
+const llhttp_settings_t &response_settings() {
+  static llhttp_settings_t settings = [] {
+    llhttp_settings_t s;
+    llhttp_settings_init(&s);
+    s.on_message_complete = on_message_complete;
+    return s;
+  }();
+  return settings;
+}
+
+// clients are freed once the loop is done, a closed one reconnects until the run is over
+void on_close(uv_handle_t *handle) {
+  client *c = (client *)handle;
+  if (!c->m_thread->m_stopping) connect_client(c);
+}
+
+void close_client(client *c) {
+  if (!uv_is_closing((uv_handle_t *)&c->m_handle)) uv_close((uv_handle_t *)&c->m_handle, on_close);
+}
+
+void on_alloc(uv_handle_t *handle, size_t, uv_buf_t *buf) {
+  client *c = (client *)handle;
+  *buf = uv_buf_init(c->m_buf, sizeof(c->m_buf));
+}
+
+void on_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf) {
+  client *c = (client *)stream;
+  load_thread *t = c->m_thread;
+  if (nread < 0) {
+    if (nread != UV_EOF) t->m_read_errors++;
+    return close_client(c);
+  }
+  t->m_bytes += nread;
+  enum llhttp_errno err = llhttp_execute(&c->m_parser, buf->base, nread);
+  if (HPE_OK == err) return;
+  if (HPE_PAUSED != err) {
+    t->m_read_errors++;
+    return close_client(c);
+  }
+  llhttp_resume(&c->m_parser);
+  if (t->m_stopping || !c->m_keep_alive) return close_client(c);
+  send_request(c);
+}
+
+void on_write(uv_write_t *req, int status) {
+  if (status < 0) {
+    client *c = (client *)req->handle;
+    c->m_thread->m_read_errors++;
+    close_client(c);
+  }
+}
+
+void send_request(client *c) {
+  c->m_sent_at = uv_hrtime();
+  uv_write(&c->m_write, (uv_stream_t *)&c->m_handle, &c->m_thread->m_request, 1, on_write);
+}
+
+void on_connect(uv_connect_t *req, int status) {
+  client *c = (client *)req->handle;
+  if (status < 0) {
+    c->m_thread->m_connect_errors++;
+    // the server may be gone, don't spin on reconnecting
+    if (c->m_thread->m_connect_errors > 1000) return stop(c->m_thread);
+    return close_client(c);
+  }
+  uv_tcp_nodelay(&c->m_handle, 1);
+  llhttp_init(&c->m_parser, HTTP_RESPONSE, &response_settings());
+  c->m_parser.data = c;
+  uv_read_start((uv_stream_t *)&c->m_handle, on_alloc, on_read);
+  send_request(c);
+}
+
+void connect_client(client *c) {
+  uv_tcp_init(&c->m_thread->m_loop, &c->m_handle);
+  uv_tcp_connect(&c->m_connect, &c->m_handle, (const sockaddr *)c->m_thread->m_addr, on_connect);
+}
+
+void stop(load_thread *t) {
+  if (t->m_stopping) return;
+  t->m_stopping = true;
+  for (client *c : t->m_clients) close_client(c);
+  uv_close((uv_handle_t *)&t->m_stop_timer, nullptr);
+}
+
+void on_stop(uv_timer_t *timer) { stop((load_thread *)timer->data); }
+
+void run(load_thread *t, unsigned nconnections) {
+  uv_loop_init(&t->m_loop);
+  uv_timer_init(&t->m_loop, &t->m_stop_timer);
+  t->m_stop_timer.data = t;
+  uv_timer_start(&t->m_stop_timer, on_stop, t->m_options->m_seconds * 1000, 0);
+  for (unsigned i = 0; i < nconnections; i++) {
+    client *c = new client();
+    c->m_thread = t;
+    t->m_clients.push_back(c);
+    connect_client(c);
+  }
+  uv_run(&t->m_loop, UV_RUN_DEFAULT);
+  uv_loop_close(&t->m_loop);
+  for (client *c : t->m_clients) delete c;
+}
+
+// latency at 'q' (0.5 for the median) of the sorted samples, in microseconds
+double percentile(const std::vector<uint64_t> &sorted, double q) {
+  if (sorted.empty()) return 0;
+  size_t i = std::min(sorted.size() - 1, (size_t)(q * sorted.size()));
+  return sorted[i] / 1000.0;
+}
+
+bool parse_url(const std::string &url, options &opts) {
+  std::string rest = url;
+  if (rest.starts_with("http://")) rest = rest.substr(7);
+  size_t slash = rest.find('/');
+  opts.m_path = slash == std::string::npos ? "/" : rest.substr(slash);
+  std::string authority = rest.substr(0, slash);
+  size_t colon = authority.rfind(':');
+  if (colon != std::string::npos) {
+    opts.m_port = std::atoi(authority.c_str() + colon + 1);
+    authority = authority.substr(0, colon);
+  }
+  if (!authority.empty()) opts.m_host = authority == "localhost" ? "127.0.0.1" : authority;
+  return opts.m_port > 0;
+}
+
+int usage(const char *argv0) {
+  std::fprintf(stderr, "usage: %s [-t threads] [-c connections] [-d seconds] [-H 'Name: value']... http://host:port/path\n", argv0);
+  return 1;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  options opts;
+  bool has_url = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 < argc && arg == "-t") opts.m_threads = std::atoi(argv[++i]);
+    else if (i + 1 < argc && arg == "-c") opts.m_connections = std::atoi(argv[++i]);
+    else if (i + 1 < argc && arg == "-d") opts.m_seconds = std::atoi(argv[++i]);
+    else if (i + 1 < argc && arg == "-H") opts.m_headers.push_back(argv[++i]);
+    else if (arg[0] != '-' && parse_url(arg, opts)) has_url = true;
+    else return usage(argv[0]);
+  }
+  if (!has_url || !opts.m_threads || opts.m_connections < opts.m_threads || !opts.m_seconds) return usage(argv[0]);
+
+  sockaddr_in addr;
+  if (uv_ip4_addr(opts.m_host.c_str(), opts.m_port, &addr) != 0) {
+    std::fprintf(stderr, "invalid address %s:%d\n", opts.m_host.c_str(), opts.m_port);
+    return 1;
+  }
+  std::string request = "GET " + opts.m_path + " HTTP/1.1\r\nHost: " + opts.m_host + ":" + std::to_string(opts.m_port) + "\r\n";
+  for (auto &header : opts.m_headers) request += header + "\r\n";
+  request += "\r\n";
+
+  std::printf("Running %us test @ http://%s:%d%s\n  %u threads and %u connections\n", opts.m_seconds, opts.m_host.c_str(), opts.m_port, opts.m_path.c_str(), opts.m_threads, opts.m_connections);
+  std::vector<load_thread> threads(opts.m_threads);
+  std::vector<std::thread> runners;
+  uint64_t start = uv_hrtime();
+  for (unsigned i = 0; i < opts.m_threads; i++) {
+    load_thread &t = threads[i];
+    t.m_options = &opts;
+    t.m_addr = &addr;
+    t.m_request = uv_buf_init(request.data(), request.size());
+    t.m_latencies.reserve(1 << 20);
+    unsigned nconnections = opts.m_connections / opts.m_threads + (i < opts.m_connections % opts.m_threads);
+    runners.emplace_back(run, &t, nconnections);
+  }
+  for (auto &runner : runners) runner.join();
+  double elapsed = (uv_hrtime() - start) / 1e9;
+
+  std::vector<uint64_t> latencies;
+  uint64_t bytes = 0, connect_errors = 0, read_errors = 0, non_2xx = 0;
+  for (auto &t : threads) {
+    latencies.insert(latencies.end(), t.m_latencies.begin(), t.m_latencies.end());
+    bytes += t.m_bytes;
+    connect_errors += t.m_connect_errors;
+    read_errors += t.m_read_errors;
+    non_2xx += t.m_non_2xx;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  double mean = 0;
+  for (uint64_t l : latencies) mean += l / 1000.0;
+  if (!latencies.empty()) mean /= latencies.size();
+
+  std::printf("  Latency (us)   mean %10.1f   p50 %10.1f   p99 %10.1f   p999 %10.1f   max %10.1f\n", mean, percentile(latencies, 0.5), percentile(latencies, 0.99), percentile(latencies, 0.999), percentile(latencies, 1));
+  std::printf("  %zu requests in %.2fs, %.2f MB read\n", latencies.size(), elapsed, bytes / 1e6);
+  if (connect_errors || read_errors) std::printf("  Socket errors: connect %llu, read/write %llu\n", (unsigned long long)connect_errors, (unsigned long long)read_errors);
+  if (non_2xx) std::printf("  Non-2xx responses: %llu\n", (unsigned long long)non_2xx);
+  std::printf("Requests/sec: %12.2f\nTransfer/sec: %10.2f MB\n", latencies.size() / elapsed, bytes / 1e6 / elapsed);
+  return 0;
+}
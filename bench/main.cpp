@@ -0,0 +1,13 @@
+#include <cstring>
+
+#include "bench.hpp"
+
+int main(int argc, char *argv[]) {
+  const char *filter = argc > 1 ? argv[1] : "";
+  for (auto &[name, fn] : fc::bench::cases()) {
+    if (!std::strstr(name, filter)) continue;
+    std::printf("# %s\n", name);
+    fn();
+  }
+  return 0;
+}
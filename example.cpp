@@ -18,24 +18,28 @@ public:
 };
 
 std::vector<user_schema> users;
+// GET responses under "/users", dropped whenever a user is created or deleted
+fc::response_cache users_cache(5000);
 
-fc::response create(fc::request req) {
+fc::response create(fc::request &req) {
   auto body = req.json();
   user_schema user(body["email"], body["password"]);
   users.push_back(user);
+  users_cache.invalidate("/users");
   return fc::response::ok(fc::status::CREATED);
 }
 
-fc::response delet(fc::request req) {
+fc::response delet(fc::request &req) {
   auto id = (std::stoi(req.get_param("id").value())) - 1;
   if (id >= users.size() || users.at(id).m_is_deleted) {
     return fc::response::ok(fc::status::NOT_FOUND);
   }
   users.at(id).m_is_deleted = true;
+  users_cache.invalidate("/users");
   return fc::response::ok(fc::status::NO_CONTENT);
 }
 
-fc::response find_many(fc::request req) {
+fc::response find_many(fc::request &req) {
   nlohmann::json json = nlohmann::json::object();
   for (user_schema &u : users) {
     if (u.m_is_deleted) continue;
@@ -44,7 +48,7 @@ fc::response find_many(fc::request req) {
   return fc::response::json(json);
 }
 
-fc::response find_by_id(fc::request req) {
+fc::response find_by_id(fc::request &req) {
   auto id = (std::stoi(req.get_param("id").value())) - 1;
   if (id >= users.size() || users.at(id).m_is_deleted) {
     return fc::response::ok(fc::status::NOT_FOUND);
@@ -52,8 +56,12 @@ fc::response find_by_id(fc::request req) {
   return fc::response::json({{"email", users.at(id).m_email}, {"password", users.at(id).m_password}});
 }
 
-fc::response auth_middleware(fc::request);
-fc::response logger_middleware(fc::request);
+fc::response health(fc::request &req) {
+  return fc::response::ok();
+}
+
+fc::response auth_middleware(fc::request &);
+fc::response logger_middleware(fc::request &);
 
 int main(int argc, char *argv[]) {
   // mocked users
@@ -66,6 +74,7 @@ int main(int argc, char *argv[]) {
   // middlewares
   router.use(auth_middleware);
   router.use(logger_middleware);
+  router.use(users_cache);
 
   router.post("", create);
   router.get("", find_many);
@@ -73,15 +82,19 @@ int main(int argc, char *argv[]) {
   router.delet("/:id", delet);
 
   app.use(router);
+  // hot endpoints can be dispatched from a table built at compile time
+  app.use(fc::routes<fc::get<"/health", health>>{});
+  // Prometheus scrape target
+  app.expose_metrics("/metrics");
 
   app.listen(":8000", [](auto &addr) { std::cout << "Listening at " << addr << std::endl; });
 }
 
-fc::response logger_middleware(fc::request req) {
+fc::response logger_middleware(fc::request &req) {
   return req.next();
 }
 
-fc::response auth_middleware(fc::request req) {
+fc::response auth_middleware(fc::request &req) {
   static std::string token = "uGhTVjLwDb0R/s4xR3mwX/AdymqNbV9htkcRiulIw3E=";
   if (auto authToken = req.get_header("Authorization"); authToken.has_value()) {
     if (!authToken.value().starts_with("Bearer ")) goto unauthorized;
@@ -1,8 +1,14 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <functional>
+#include <memory>
+#include <memory_resource>
 #include <optional>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <sys/stat.h>
@@ -102,65 +108,460 @@ enum class status {
   NETWORK_AUTHENTICATION_REQUIRED = 511
 };
 
+// Headers indexed in a fixed slot of every request, see 'request::get_header(header)'
+enum class header {
+  HOST = 0,
+  CONTENT_LENGTH,
+  CONTENT_TYPE,
+  AUTHORIZATION,
+  COOKIE,
+  CONNECTION,
+  ACCEPT_ENCODING,
+
+  // used internally to keep track of well-known headers len
+  COUNT,
+};
+
 struct request;
 struct response;
 
-using path_handler = std::function<response(request)>;
+// Thrown by a handler, or by the request accessors on bad input, to answer with 'status' and its
+// reason phrase instead of the response the handler would have returned
+struct http_error : public std::runtime_error {
+public:
+  explicit http_error(status status, const std::string &what = "") : std::runtime_error(what), m_status(status) {}
+  status get_status() const { return m_status; }
+
+private:
+  status m_status;
+};
+
+// Pops the next non-empty segment off the front of 'path', repeated slashes are skipped and
+// the query string (or fragment) ends the path. Returns false once no segment is left.
+constexpr bool next_segment(std::string_view &path, std::string_view &segment) {
+  size_t start = path.find_first_not_of('/');
+  if (start == std::string_view::npos || path[start] == '?' || path[start] == '#') {
+    path = {};
+    return false;
+  }
+  path.remove_prefix(start);
+  size_t end = path.find_first_of("/?#");
+  segment = path.substr(0, end);
+  path.remove_prefix(segment.length());
+  if (!path.empty() && path.front() != '/') path = {};
+  return true;
+}
+
+// String literal usable as a template argument, see 'routes'
+template <size_t N> struct fixed_string {
+  char m_data[N] = {};
+
+  constexpr fixed_string(const char (&str)[N]) {
+    for (size_t i = 0; i < N; i++) m_data[i] = str[i];
+  }
+  constexpr std::string_view view() const { return {m_data, N - 1}; }
+};
+
+template <method M, fixed_string Path, auto Handler> struct route_decl;
+template <typename... Routes> struct routes;
+
+// Middlewares and the main handler of a route all get the same request, 'request::next' only moves
+// its cursor along the handler array the route shares with every other request
+using path_handler = std::function<response(request &)>;
+
+// Body of a streamed response, see 'response::stream'. Copies all write to the same stream and
+// are safe to use from any thread, the chunks are sent by the loop owning the connection.
+struct body_stream {
+public:
+  // Queues a chunk, false once the stream ended or the client went away. Chunks are still taken
+  // past the high-water mark, 'ready' tells the producer when to hold off.
+  bool write(std::string) const;
+  // sends the last chunk, the connection then goes on with the next request
+  void end() const;
+  // false while more than the high-water mark waits to be written to the socket
+  bool ready() const;
+
+private:
+  struct state;
+  std::shared_ptr<state> m_state;
+
+  explicit body_stream(std::shared_ptr<state> state) : m_state(std::move(state)) {}
+
+  friend struct response;
+  friend struct worker;
+  friend struct connection;
+};
 
 struct response {
 public:
   static const response ok(status stats = status::OK);
-  static const response json(nlohmann::json, status status = status::OK);
+  // the tree is serialized straight into the body, see 'json_writer' to do without one
+  static const response json(const nlohmann::json &, status status = status::OK);
   static const response send(const std::filesystem::path path);
+  // same, honouring conditional (ETag, Last-Modified), Range and precompressed (.br, .gz) requests
+  static const response send(const request &, const std::filesystem::path path);
+  // returned by a handler that deferred its request, the actual response goes through the responder
+  static const response pending();
+  // Answered with the message the server keeps serialized for 'status' (400, 404, 405, 408, 413,
+  // 429, 431, 500, 501 and 503), nothing is formatted per request and headers set on it are not
+  // sent. Meant for refusing requests in bulk, any other status goes out as 'ok(status)'.
+  static const response canned(status);
+  // Response sent with chunked transfer encoding (HTTP/1.0 clients read until the connection
+  // closes) while its body is produced. 'pull' is called on the loop once the head was written and
+  // each time the queued chunks drain under the low-water mark, it writes until 'ready' turns false
+  // or keeps a copy of the stream to write from elsewhere (server-sent events). Nothing else is read
+  // from the connection until the stream ended, body segments appended meanwhile form the first chunk.
+  static response stream(request &, std::function<void(body_stream &)> pull);
 
   void set_status(status);
   status get_status() const { return m_status; }
   void set_content_type(const std::string);
-  const std::string &to_string() const { return m_raw; }
+  void set_header(std::string_view name, std::string_view value);
+
+  // Body segments are written one after the other without being copied into the header block,
+  // the response keeps them alive until the write is done. A shared segment can be handed to any
+  // number of responses, a static one must outlive all of them (a literal, a precomputed blob).
+  void append_body(std::string);
+  void append_body(std::shared_ptr<const std::string>);
+  void append_static_body(std::string_view);
+  size_t content_length() const;
+
+  // whole serialized message, a copy meant for tests and debugging
+  std::string to_string() const;
 
 private:
-  std::string m_raw;
+  struct segment {
+    std::string_view m_data;
+    std::shared_ptr<const void> m_owner; // null for static data
+  };
+  // file range written after the body segments straight from the page cache (sendfile)
+  struct file_part {
+    std::shared_ptr<const void> m_owner; // closes the file
+    int m_fd;
+    int64_t m_offset;
+    size_t m_length;
+  };
+
   status m_status;
+  // precomputed "Content-Type: ...\r\n" line, unless a custom type was set
+  const char *m_content_type_line;
   std::string m_content_type;
+  // extra header lines, each one ending with "\r\n"
+  std::string m_headers;
+  std::vector<segment> m_body;
+  std::optional<file_part> m_file;
+  bool m_pending;
+  bool m_canned;
+  // Whole message serialized beforehand (see 'response_cache'), the head without its blank line
+  // first: the connection header goes in between, nothing else is formatted
+  std::shared_ptr<const std::string> m_serialized;
+  size_t m_serialized_head;
+  // set when the body is streamed, no Content-Length is sent
+  std::shared_ptr<body_stream::state> m_stream;
+
+  response(status status, const char *content_type_line) : m_status(status), m_content_type_line(content_type_line), m_pending(false), m_canned(false), m_serialized(), m_serialized_head(0) {}
+
+  // status line and headers, 'extra' is spliced in right before the blank line
+  void write_head(std::string &, std::string_view extra = {}) const;
+  static response file(const request *, const std::filesystem::path &);
+
+  friend struct worker;
+  friend struct metrics;
+  friend struct compression;
+  friend struct json_writer;
+  friend struct response_cache;
+};
+
+// Writes JSON into a response body, or a stream, as it goes instead of building a 'nlohmann::json'
+// tree first: e.g. 'w.begin_array(); for (auto &u : users) w.begin_object().key("id").value(u.id).end_object(); w.end_array();'.
+// The text is cut into segments of a few KB handed over as they fill up, never reallocated whole.
+// The caller keeps the nesting balanced, keys are written as given.
+struct json_writer {
+public:
+  // replaces the body of 'res', e.g. from 'response::ok()', and sets its content type to JSON
+  explicit json_writer(response &res);
+  // each full segment goes out as a chunk
+  explicit json_writer(body_stream stream);
+  json_writer(const json_writer &) = delete;
+  // flushes what is left
+  ~json_writer();
+
+  json_writer &begin_object();
+  json_writer &end_object();
+  json_writer &begin_array();
+  json_writer &end_array();
+  json_writer &key(std::string_view);
+
+  json_writer &value(std::string_view);
+  json_writer &value(const char *str) { return value(std::string_view(str)); }
+  json_writer &value(const std::string &str) { return value(std::string_view(str)); }
+  json_writer &value(bool);
+  json_writer &value(int v) { return value(static_cast<long long>(v)); }
+  json_writer &value(long v) { return value(static_cast<long long>(v)); }
+  json_writer &value(long long);
+  json_writer &value(unsigned v) { return value(static_cast<unsigned long long>(v)); }
+  json_writer &value(unsigned long v) { return value(static_cast<unsigned long long>(v)); }
+  json_writer &value(unsigned long long);
+  json_writer &value(double);
+  json_writer &value(std::nullptr_t);
+  // a subtree built the usual way, serialized in place
+  json_writer &value(const nlohmann::json &);
+
+  // hands the segment being filled to the response or stream
+  void flush();
+
+private:
+  response *m_res;
+  std::optional<body_stream> m_stream;
+  std::string m_buf;
+  // one entry per open object or array, true until its first member was written
+  std::vector<bool> m_first;
+  bool m_after_key;
+
+  // comma before any member of a container but the first, none after a key
+  void separate();
+  void maybe_flush();
+};
+
+// Answers a request after its handler returned, see 'request::defer'. Copies all answer the same
+// request and only the first response sent counts. Once every copy is gone without sending one,
+// the client gets a 500.
+struct responder {
+public:
+  // safe from any thread, the response is written by the loop owning the connection
+  void send(response) const;
 
-  response(std::string raw) : m_raw(std::move(raw)) {}
+private:
+  struct state;
+  std::shared_ptr<state> m_state;
+
+  explicit responder(std::shared_ptr<state> state) : m_state(std::move(state)) {}
+
+  friend struct request;
 };
 
 struct request {
 public:
   explicit request() = delete;
+  request(const request &);
+  request(request &&) noexcept;
   ~request();
 
-  nlohmann::json json();
+  // Body parsed on the first call and kept for the next ones. A malformed body throws 'http_error'
+  // with 400, one above the size or nesting limits (see 'app::set_max_json_size') with 413 and 400.
+  const nlohmann::json &json();
+  // Values of the top level members named 'keys', in that order, null for the missing ones. Read
+  // in a single pass that stops once they were all found, nothing else of the body is kept. Same
+  // errors as 'json', the result is not cached.
+  std::vector<nlohmann::json> json_fields(std::initializer_list<std::string_view> keys) const;
   method get_method() const { return m_method; }
   const void *get_remote() const { return m_uvremote; }
   const std::string_view &get_raw() const { return m_raw; };
   const std::string_view &get_path() const { return m_path; }
+  // body as received, joined when it came in chunks
+  const std::string_view &get_body() const { return m_raw_body; }
+  // in the order they were received, names as sent by the client
+  const std::pmr::vector<std::pair<std::string_view, std::string_view>> &get_headers() const { return m_headers; }
+  unsigned get_http_minor() const { return m_http_minor; }
+  // whether the client expects the connection to stay open after the response
+  bool keep_alive() const { return m_keep_alive; }
   std::optional<std::string> get_param(const std::string &) const;
-  std::optional<std::string_view> get_header(const std::string &) const;
+  // names are compared case-insensitively, the first header with that name wins
+  std::optional<std::string_view> get_header(std::string_view) const;
+  std::optional<std::string_view> get_header(header) const;
   std::optional<std::string_view> get_cookie(const std::string &);
   response next();
+  // Lets the handler return 'response::pending()' and answer later. No other request is read from
+  // the connection meanwhile, the views into this one (headers, params, body) stay valid until then.
+  responder defer();
 
 private:
+  void index_header(size_t pos);
+
   const void *m_uvremote;
+  // per-request arena owned by the connection, rewound once the response is handed to the write path
+  std::pmr::memory_resource *m_arena;
 
   method m_method;
   std::string_view m_raw;
   std::string_view m_path;
   std::string_view m_raw_body;
-  std::vector<std::pair<std::string_view, std::string>> m_params;
-  std::vector<std::pair<std::string_view, std::string_view>> m_headers;
+  // only used when the body arrives in pieces (chunked encoding) and has to be joined
+  std::vector<char> m_body_buf;
+  // values are views into the url
+  std::pmr::vector<std::pair<std::string_view, std::string_view>> m_params;
+  std::pmr::vector<std::pair<std::string_view, std::string_view>> m_headers;
+  // built by the parser as field names complete, lives in the arena
+  struct header_index;
+  header_index *m_header_index;
   struct cookies;
   cookies *m_cookies;
+  // parsed body, shared by the copies of this request
+  std::shared_ptr<nlohmann::json> m_json;
+  // 0 when not bound to a worker, no limit then
+  size_t m_max_json_size;
+  unsigned m_max_json_depth;
+
+  bool m_keep_alive;
+  unsigned char m_http_minor;
 
-  // middlewares + main handler
-  std::vector<path_handler> m_handlers;
+  // middlewares + main handler of the matched route, called from the back
+  const std::vector<path_handler> *m_handlers;
+  size_t m_next_handler;
+  // id of the matched route for the metrics, 0 until one matched
+  unsigned m_route;
 
-  request(void *remote, std::string_view raw) : m_uvremote(remote), m_raw(raw) {};
+  request(void *remote, std::string_view raw, std::pmr::memory_resource *arena)
+      : m_uvremote(remote), m_arena(arena), m_raw(raw), m_params(arena), m_headers(arena), m_header_index(nullptr), m_cookies(nullptr), m_max_json_size(0), m_max_json_depth(0), m_keep_alive(false), m_http_minor(1), m_handlers(nullptr), m_next_handler(0), m_route(0) {};
 
+  friend struct worker;
   friend struct root_router;
   friend struct http_parser;
-  friend request request_factory(void *remote, std::string_view raw);
+  friend struct metrics;
+  friend request request_factory(void *remote, std::string_view raw, std::pmr::memory_resource *arena);
+  template <method M, fixed_string Path, auto Handler> friend struct route_decl;
+  template <typename... Routes> friend struct routes;
+};
+
+// Route declared at compile time: the path is split into segments by the compiler and the handler
+// is called directly, without going through a 'path_handler'. Dynamic segments (':name') and a
+// trailing wildcard ('*') behave as in the runtime router, middlewares are not supported.
+template <method M, fixed_string Path, auto Handler> struct route_decl {
+public:
+  static constexpr method m_method = M;
+  static constexpr std::string_view m_path = Path.view();
+
+  static constexpr size_t m_nsegments = [] {
+    size_t n = 0;
+    std::string_view path = Path.view(), segment;
+    while (next_segment(path, segment)) n++;
+    return n;
+  }();
+
+  static constexpr std::array<std::string_view, m_nsegments> m_segments = [] {
+    std::array<std::string_view, m_nsegments> segments{};
+    std::string_view path = Path.view();
+    for (auto &segment : segments) next_segment(path, segment);
+    return segments;
+  }();
+
+  static constexpr size_t m_nparams = [] {
+    size_t n = 0;
+    for (auto segment : m_segments) n += segment.starts_with(':');
+    return n;
+  }();
+
+  static_assert([] {
+    for (size_t i = 0; i + 1 < m_nsegments; i++)
+      if (m_segments[i] == "*") return false;
+    return true;
+  }(), "Wildcard must be the last segment of a route");
+
+  // On a match the values of the dynamic segments are appended to the request params
+  static bool match(request &req) {
+    std::array<std::string_view, m_nparams> values;
+    std::string_view path = req.m_path, segment;
+    size_t nvalues = 0;
+    for (std::string_view expected : m_segments) {
+      if (!next_segment(path, segment)) return false;
+      // swallows the rest of the path
+      if (expected == "*") return push_params(req, values, nvalues);
+      if (expected.starts_with(':')) {
+        values[nvalues++] = segment;
+      } else if (segment != expected) {
+        return false;
+      }
+    }
+    if (next_segment(path, segment)) return false;
+    return push_params(req, values, nvalues);
+  }
+
+  static response call(request &req) { return Handler(req); }
+
+private:
+  static bool push_params(request &req, const std::array<std::string_view, m_nparams> &values, size_t nvalues) {
+    size_t i = 0;
+    for (std::string_view name : m_segments) {
+      if (i < nvalues && name.starts_with(':')) req.m_params.emplace_back(name.substr(1), values[i++]);
+    }
+    return true;
+  }
+};
+
+template <fixed_string Path, auto Handler> using get = route_decl<method::GET, Path, Handler>;
+template <fixed_string Path, auto Handler> using post = route_decl<method::POST, Path, Handler>;
+template <fixed_string Path, auto Handler> using put = route_decl<method::PUT, Path, Handler>;
+template <fixed_string Path, auto Handler> using delet = route_decl<method::DELETE, Path, Handler>;
+template <fixed_string Path, auto Handler> using patch = route_decl<method::PATCH, Path, Handler>;
+
+// returns true when one of the routes answered the request, its response is left in the optional
+using static_dispatch = bool (*)(request &, std::optional<response> &);
+
+// Route table fixed at compile time, e.g. 'app.use(fc::routes<fc::get<"/users/:id", find_by_id>>{})'.
+// Routes are tried in declaration order, all of them before the routes added at runtime.
+template <typename... Routes> struct routes {
+public:
+  static constexpr std::array<std::pair<method, std::string_view>, sizeof...(Routes)> m_routes = {{{Routes::m_method, Routes::m_path}...}};
+
+  // the position of the route that answered is left in 'request::m_route'
+  static bool dispatch(request &req, std::optional<response> &res) {
+    unsigned i = 0;
+    return (((Routes::m_method == req.get_method() && Routes::match(req) && (req.m_route = i, res.emplace(Routes::call(req)), true)) || (i++, false)) || ...);
+  }
+};
+
+// Middleware refusing clients going over 'rate' requests per second, with bursts of up to 'burst',
+// with a 429 and Retry-After. Clients are told apart by their address, or by the value of
+// 'key_header' when the request has it. That header is a list each proxy appends to (as
+// X-Forwarded-For), only the entries added by the 'trusted_hops' proxies in front of the server
+// can be believed: the client is the one 'trusted_hops' from the end, anything before it is sent
+// by the client itself. A list shorter than that didn't come through those proxies, the address
+// is used then. A token bucket is kept for each client in a table shared by every worker, split
+// into shards each behind its own lock, holding 'capacity' clients at most: the least recently
+// seen one makes room for a new one, starting over with a full bucket.
+struct rate_limit {
+public:
+  rate_limit(double rate, double burst, std::string key_header = "", unsigned trusted_hops = 1, size_t capacity = 65536);
+
+  response operator()(request &) const;
+
+  // shared by every copy of the middleware
+  struct table;
+
+private:
+  std::shared_ptr<table> m_table;
+  std::string m_key_header;
+  unsigned m_trusted_hops;
+};
+
+// Middleware keeping the responses of GET routes fully serialized for 'ttl' milliseconds, a hit is
+// written out without calling the handler. Responses are told apart by their normalized path
+// (query string included) and the values of the request headers named in 'vary'. Only 200
+// responses returned by the handler itself are kept, not deferred, streamed or file ones, nor those
+// setting a cookie or marked 'Cache-Control: no-store' or 'private'. With compression on, the coding
+// negotiated with the client is part of the key and responses are stored compressed, bodies the
+// worker would compress on the thread pool are not kept. At most 'max_bytes' are kept, the least
+// recently used responses making room for new ones. Every copy of the middleware shares the same
+// entries, and every worker.
+struct response_cache {
+public:
+  // 'name' labels the counters exported by 'app::expose_metrics'
+  explicit response_cache(unsigned ttl, size_t max_bytes = 64 * 1024 * 1024, std::vector<std::string> vary = {}, std::string name = "default");
+
+  response operator()(request &) const;
+  // drops the responses whose normalized path starts with 'prefix', e.g. "/users" once one changed,
+  // returns how many there were
+  size_t invalidate(std::string_view prefix) const;
+
+  uint64_t hits() const;
+  uint64_t misses() const;
+  uint64_t evictions() const;
+
+  // shared by every copy of the middleware
+  struct store;
+
+private:
+  std::shared_ptr<store> m_store;
 };
 
 struct router {
@@ -204,14 +605,74 @@ public:
   void patch(const std::string, path_handler);
 
   void use(const router &);
-
-  int listen(const std::string, std::function<void(const std::string &addr)>);
+  // middleware run for every route added after it, before those of a router
+  void use(path_handler);
+  // Serves the files under 'dir' for GET requests under 'prefix', "index.html" standing for
+  // directories. Small files are kept in memory, up to 32 MB per worker: each worker holds its
+  // own copy of a file it served, so the total grows with the number of workers.
+  void serve_static(const std::string prefix, const std::filesystem::path dir);
+  template <typename... Routes> void use(routes<Routes...>) { use_static(&routes<Routes...>::dispatch, {routes<Routes...>::m_routes.begin(), routes<Routes...>::m_routes.end()}); }
+
+  // idle time in milliseconds before a keep-alive connection is closed, 0 disables the timeout
+  void set_keep_alive_timeout(unsigned);
+  // Milliseconds a client gets to send a whole request head (10 s by default), to go on with a
+  // request body between two reads (10 s) and to take some of a response (30 s). A connection
+  // past one of these is closed, after a 408 when a request was under way. 0 disables a timeout.
+  void set_header_timeout(unsigned);
+  void set_body_timeout(unsigned);
+  void set_write_timeout(unsigned);
+  // max requests served on a single connection before it is closed, 0 means unlimited
+  void set_max_requests_per_connection(unsigned);
+  // limits enforced while a request is read, larger requests are refused with 431 and 413
+  void set_max_header_size(size_t);
+  void set_max_body_size(size_t);
+  // limits enforced by 'request::json' and 'request::json_fields' before and while parsing
+  void set_max_json_size(size_t);
+  void set_max_json_depth(unsigned);
+
+  // Compresses textual response bodies with gzip or deflate, as negotiated with Accept-Encoding,
+  // 'level' going from 1 (fastest) to 9 (smallest), 0 (the default) disables compression
+  void set_compression_level(int);
+  // bodies smaller than this are sent as is, 1 KB by default
+  void set_compression_min_size(size_t);
+  // bodies from this size on are compressed on the thread pool rather than on the loop, 256 KB by
+  // default, 0 keeps them all on the loop
+  void set_compression_offload_size(size_t);
+
+  // Runs 'work' on the thread pool and answers the request with its result from the loop, the
+  // handler returns what this returns. Meant for cpu heavy work that would stall the other connections.
+  static response offload(request &, std::function<response()> work);
+  // threads running offloaded work and file io, libuv defaults to 4
+  void set_offload_threads(unsigned);
+
+  // Admission control, every limit applies to each worker and 0 (the default) disables it.
+  // Connections waiting to be accepted kept by the kernel, 128 by default
+  void set_backlog(int);
+  // once reached, the worker stops accepting until one of its connections closes
+  void set_max_connections(unsigned);
+  // requests dispatched but not answered yet (deferred or offloaded), once reached new requests
+  // are refused with a 503 and Retry-After
+  void set_max_in_flight(unsigned);
+  // Milliseconds a request may wait between being read and being dispatched. When even the
+  // quickest requests wait longer than this for 100 ms, those waiting over twice as long are
+  // refused with a 503 (CoDel) until the delay comes back down.
+  void set_shed_target(unsigned);
+
+  // Serves Prometheus text format metrics at 'path': requests, status classes, bytes and latency
+  // histograms per route, connection counters and read pool usage, summed over the workers.
+  // Nothing is recorded per route unless this is called (before 'listen').
+  void expose_metrics(const std::string path = "/metrics");
+
+  // starts 'workers' event loops, each on its own thread sharing the port, 0 means one per cpu core
+  int listen(const std::string, std::function<void(const std::string &addr)>, unsigned workers = 1);
 
 private:
   struct impl;
   impl *m_pimpl;
   friend struct impl;
 
+  void use_static(static_dispatch, std::vector<std::pair<method, std::string_view>>);
+
   friend void parse_http_request(request);
 };
 
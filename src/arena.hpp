@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+#include "pool.hpp"
+
+namespace fc {
+
+// Bump allocator backing the per-request state (headers, params, handler chain, cookies).
+// Nothing is freed one by one: 'reset' rewinds to the first block once the response was
+// handed to the write path, 'release' gives every block back when the connection goes idle.
+// Blocks are slabs of the worker read pool, or plain heap blocks when there is no pool.
+struct arena : public std::pmr::memory_resource {
+public:
+  explicit arena(buffer_pool *pool = nullptr, size_t block_size = 1024 * 16) : m_pool(pool), m_block_size(pool ? pool->m_slab_size : block_size), m_head(nullptr), m_cur(nullptr), m_end(nullptr) {}
+  arena(const arena &) = delete;
+  ~arena() { release(); }
+
+  void reset() {
+    if (!m_head) return;
+    while (m_head->m_prev) pop_block();
+    m_cur = (char *)(m_head + 1);
+    m_end = (char *)m_head + m_head->m_size;
+  }
+
+  void release() {
+    while (m_head) pop_block();
+    m_cur = m_end = nullptr;
+  }
+
+private:
+  struct block {
+    block *m_prev;
+    size_t m_size;
+  };
+
+  buffer_pool *m_pool;
+  size_t m_block_size;
+  block *m_head;
+  char *m_cur;
+  char *m_end;
+
+  void *do_allocate(size_t bytes, size_t alignment) override {
+    char *at = align(m_cur, alignment);
+    if (!m_head || at + bytes > m_end) {
+      push_block(bytes + alignment);
+      at = align(m_cur, alignment);
+    }
+    m_cur = at + bytes;
+    return at;
+  }
+
+  void do_deallocate(void *, size_t, size_t) override {}
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+  static char *align(char *at, size_t alignment) {
+    return (char *)(((uintptr_t)at + alignment - 1) & ~(uintptr_t)(alignment - 1));
+  }
+
+  void push_block(size_t min_size) {
+    size_t size = m_block_size;
+    if (min_size + sizeof(block) > size) size = min_size + sizeof(block);
+    char *mem = (m_pool && size == m_block_size) ? m_pool->acquire(size) : new char[size];
+    block *b = (block *)mem;
+    b->m_prev = m_head;
+    b->m_size = size;
+    m_head = b;
+    m_cur = (char *)(b + 1);
+    m_end = mem + size;
+  }
+
+  void pop_block() {
+    block *b = m_head;
+    m_head = b->m_prev;
+    if (m_pool && b->m_size == m_block_size) {
+      m_pool->release((char *)b, b->m_size);
+    } else {
+      delete[] (char *)b;
+    }
+  }
+};
+
+} // namespace fc
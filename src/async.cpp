@@ -0,0 +1,84 @@
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <uv.h>
+
+#include "conn.hpp"
+#include "include/fc.hpp"
+#include "worker.hpp"
+
+namespace fc {
+
+struct responder::state {
+public:
+  worker *m_worker;
+  connection *m_conn;
+  std::atomic<bool> m_sent;
+
+  state(worker *worker, connection *conn) : m_worker(worker), m_conn(conn), m_sent(false) {}
+  state(const state &) = delete;
+  ~state() {
+    // nobody answered, the connection would otherwise wait forever
+    if (!m_sent.load()) m_worker->post_deferred(m_conn, response::ok(status::INTERNAL_SERVER_ERROR));
+  }
+};
+
+void responder::send(response res) const {
+  if (m_state->m_sent.exchange(true)) return;
+  m_state->m_worker->post_deferred(m_state->m_conn, std::move(res));
+}
+
+responder request::defer() {
+  connection *conn = (connection *)m_uvremote;
+  if (!conn) throw std::runtime_error("Request is not bound to a connection");
+  if (conn->m_deferred) throw std::runtime_error("Request already deferred");
+  conn->m_deferred = true;
+  return responder(std::make_shared<responder::state>((worker *)conn->m_handle.loop->data, conn));
+}
+
+namespace {
+
+struct offload_ctx {
+  uv_work_t m_work;
+  responder m_responder;
+  std::function<response()> m_fn;
+  std::optional<response> m_result;
+};
+
+void on_offload_work(uv_work_t *work) {
+  offload_ctx *ctx = (offload_ctx *)work->data;
+  try {
+    ctx->m_result.emplace(ctx->m_fn());
+  } catch (const http_error &e) {
+    ctx->m_result.emplace(response::ok(e.get_status()));
+  } catch (const std::exception &e) {
+    std::cerr << "[FALCON ERROR]: Offloaded work failed, " << e.what() << std::endl;
+    ctx->m_result.emplace(response::ok(status::INTERNAL_SERVER_ERROR));
+  } catch (...) {
+    // anything escaping here would end the process from a thread pool thread
+    std::cerr << "[FALCON ERROR]: Offloaded work failed" << std::endl;
+    ctx->m_result.emplace(response::ok(status::INTERNAL_SERVER_ERROR));
+  }
+}
+
+void on_offload_done(uv_work_t *work, int status) {
+  offload_ctx *ctx = (offload_ctx *)work->data;
+  if (ctx->m_result) ctx->m_responder.send(std::move(*ctx->m_result));
+  delete ctx;
+}
+
+} // namespace
+
+response app::offload(request &req, std::function<response()> work) {
+  connection *conn = (connection *)req.get_remote();
+  offload_ctx *ctx = new offload_ctx{{}, req.defer(), std::move(work), {}};
+  ctx->m_work.data = ctx;
+  uv_queue_work(conn->m_handle.loop, &ctx->m_work, on_offload_work, on_offload_done);
+  return response::pending();
+}
+
+} // namespace fc
@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <uv.h>
+#include <vector>
+
+#include "cache.hpp"
+#include "compress.hpp"
+#include "conn.hpp"
+#include "include/fc.hpp"
+#include "metrics.hpp"
+#include "req.hpp"
+#include "worker.hpp"
+
+namespace fc {
+
+namespace {
+
+// Caches alive, whatever app exports its metrics. Never destroyed: a cache defined at namespace
+// scope in another translation unit may well outlive statics of this one.
+std::mutex &registry_mutex() {
+  static std::mutex *mutex = new std::mutex;
+  return *mutex;
+}
+
+std::vector<const response_cache::store *> &registry() {
+  static auto *stores = new std::vector<const response_cache::store *>;
+  return *stores;
+}
+
+// responses meant for one client only, or not to be stored at all
+bool cacheable(const response &res, std::string_view lines) {
+  if (res.get_status() != status::OK) return false;
+  while (!lines.empty()) {
+    size_t eol = lines.find("\r\n");
+    std::string_view line = lines.substr(0, eol);
+    lines.remove_prefix(eol == std::string_view::npos ? lines.size() : eol + 2);
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos) continue;
+    std::string_view name = line.substr(0, colon), value = line.substr(colon + 1);
+    if (iequals(name, "set-cookie")) return false;
+    if (iequals(name, "cache-control") && (value.find("no-store") != std::string_view::npos || value.find("private") != std::string_view::npos)) return false;
+  }
+  return true;
+}
+
+} // namespace
+
+std::string cache_key(const request &req, const std::vector<std::string> &vary) {
+  std::string_view path = req.get_path(), rest = path, segment;
+  std::string key;
+  key.reserve(path.size() + 16 * vary.size());
+  while (next_segment(rest, segment)) key.append("/").append(segment);
+  if (key.empty()) key = "/";
+  size_t query = path.find('?');
+  if (query != std::string_view::npos) key.append(path.substr(query, path.find('#', query) - query));
+  for (const std::string &name : vary) {
+    // a missing header is told apart from an empty one
+    key.push_back('\n');
+    if (auto value = req.get_header(name)) key.append("=").append(*value);
+  }
+  return key;
+}
+
+response_cache::store::store(unsigned ttl_ms, size_t max_bytes, std::vector<std::string> vary, std::string name)
+    : m_ttl(uint64_t(ttl_ms) * 1000000), m_shard_budget(max_bytes / FC_CACHE_SHARDS), m_vary(std::move(vary)), m_name(std::move(name)), m_shards(new shard[FC_CACHE_SHARDS]) {
+  std::lock_guard<std::mutex> lock(registry_mutex());
+  registry().push_back(this);
+}
+
+response_cache::store::~store() {
+  std::lock_guard<std::mutex> lock(registry_mutex());
+  std::vector<const store *> &stores = registry();
+  stores.erase(std::find(stores.begin(), stores.end(), this));
+}
+
+response_cache::store::shard &response_cache::store::shard_of(std::string_view key) { return m_shards[std::hash<std::string_view>{}(key) % FC_CACHE_SHARDS]; }
+
+void response_cache::store::shard::erase(std::list<entry>::iterator it) {
+  m_bytes -= it->m_message->size() + it->m_key.size();
+  m_index.erase(it->m_key);
+  m_lru.erase(it);
+}
+
+std::shared_ptr<const std::string> response_cache::store::find(const std::string &key, uint64_t now, size_t *head) {
+  shard &s = shard_of(key);
+  std::lock_guard<std::mutex> lock(s.m_mutex);
+  auto found = s.m_index.find(key);
+  if (found == s.m_index.end()) {
+    bump(s.m_misses);
+    return nullptr;
+  }
+  auto it = found->second;
+  if (it->m_expires <= now) {
+    s.erase(it);
+    bump(s.m_misses);
+    return nullptr;
+  }
+  s.m_lru.splice(s.m_lru.begin(), s.m_lru, it);
+  bump(s.m_hits);
+  *head = it->m_head;
+  return it->m_message;
+}
+
+void response_cache::store::insert(std::string key, std::shared_ptr<const std::string> message, size_t head, uint64_t now) {
+  size_t bytes = message->size() + key.size();
+  if (bytes > m_shard_budget / FC_CACHE_MAX_ENTRY_SHARE) return;
+  shard &s = shard_of(key);
+  std::lock_guard<std::mutex> lock(s.m_mutex);
+  // another worker may have answered the same miss meanwhile, the latest response wins
+  if (auto found = s.m_index.find(key); found != s.m_index.end()) s.erase(found->second);
+  while (s.m_bytes + bytes > m_shard_budget && !s.m_lru.empty()) {
+    s.erase(std::prev(s.m_lru.end()));
+    bump(s.m_evictions);
+  }
+  s.m_lru.push_front({std::move(key), std::move(message), head, now + m_ttl});
+  // the map keys view the key owned by the list entry
+  s.m_index.emplace(s.m_lru.front().m_key, s.m_lru.begin());
+  s.m_bytes += bytes;
+}
+
+size_t response_cache::store::invalidate(std::string_view prefix) {
+  size_t dropped = 0;
+  for (size_t i = 0; i < FC_CACHE_SHARDS; i++) {
+    shard &s = m_shards[i];
+    std::lock_guard<std::mutex> lock(s.m_mutex);
+    for (auto it = s.m_lru.begin(); it != s.m_lru.end();) {
+      auto next = std::next(it);
+      if (it->m_key.starts_with(prefix)) {
+        s.erase(it);
+        dropped++;
+      }
+      it = next;
+    }
+  }
+  return dropped;
+}
+
+uint64_t response_cache::store::total(std::atomic<uint64_t> shard::*counter) const {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < FC_CACHE_SHARDS; i++) sum += (m_shards[i].*counter).load(std::memory_order_relaxed);
+  return sum;
+}
+
+response_cache::response_cache(unsigned ttl, size_t max_bytes, std::vector<std::string> vary, std::string name) : m_store(std::make_shared<store>(ttl, max_bytes, std::move(vary), std::move(name))) {}
+
+response response_cache::operator()(request &req) const {
+  if (req.get_method() != method::GET) return req.next();
+  connection *conn = (connection *)req.get_remote();
+  const settings *config = conn ? &((worker *)conn->m_handle.loop->data)->m_settings : nullptr;
+  bool compressing = config && config->m_compression_level;
+  std::string key = cache_key(req, m_store->m_vary);
+  // each coding is its own entry, the identity one carrying the Vary header as well
+  if (compressing && conn->m_coding != content_coding::IDENTITY) key.append(conn->m_coding == content_coding::GZIP ? "\ngzip" : "\ndeflate");
+  size_t head = 0;
+  if (auto message = m_store->find(key, uv_hrtime(), &head)) {
+    response res(status::OK, nullptr);
+    res.m_serialized = std::move(message);
+    res.m_serialized_head = head;
+    return res;
+  }
+  response res = req.next();
+  if (res.m_pending || res.m_stream || res.m_file || res.m_canned || res.m_serialized || !cacheable(res, res.m_headers)) return res;
+  // stored the way the worker would send it to this client, hits skip compression
+  if (compressing && compression::eligible(res, config->m_compression_min_size)) {
+    if (conn->m_coding == content_coding::IDENTITY) compression::add_vary(res);
+    else if (config->m_compression_offload_size && res.content_length() >= config->m_compression_offload_size) return res;
+    else if (!compression::apply(res, conn->m_coding, config->m_compression_level)) return res;
+  }
+  // the head without its blank line, the connection header of each client goes there
+  std::string message;
+  message.reserve(256 + res.content_length());
+  res.write_head(message);
+  message.resize(message.size() - 2);
+  size_t head_size = message.size();
+  for (auto &seg : res.m_body) message.append(seg.m_data);
+  m_store->insert(std::move(key), std::make_shared<const std::string>(std::move(message)), head_size, uv_hrtime());
+  return res;
+}
+
+size_t response_cache::invalidate(std::string_view prefix) const { return m_store->invalidate(prefix); }
+
+uint64_t response_cache::hits() const { return m_store->total(&store::shard::m_hits); }
+uint64_t response_cache::misses() const { return m_store->total(&store::shard::m_misses); }
+uint64_t response_cache::evictions() const { return m_store->total(&store::shard::m_evictions); }
+
+void render_cache_metrics(std::string &out) {
+  std::lock_guard<std::mutex> lock(registry_mutex());
+  const std::vector<const response_cache::store *> &stores = registry();
+  if (stores.empty()) return;
+  auto append = [&out, &stores](std::string_view name, std::string_view help, std::atomic<uint64_t> response_cache::store::shard::*counter) {
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n# TYPE ").append(name).append(" counter\n");
+    for (const response_cache::store *store : stores) {
+      out.append(name).append("{cache=\"").append(store->m_name).append("\"} ").append(std::to_string(store->total(counter))).push_back('\n');
+    }
+  };
+  append("falcon_cache_hits_total", "Requests answered from a response cache.", &response_cache::store::shard::m_hits);
+  append("falcon_cache_misses_total", "Requests a response cache had nothing fresh for.", &response_cache::store::shard::m_misses);
+  append("falcon_cache_evictions_total", "Responses dropped to make room for newer ones.", &response_cache::store::shard::m_evictions);
+}
+
+} // namespace fc
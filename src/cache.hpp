@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "include/fc.hpp"
+
+#define FC_CACHE_SHARDS (16)         // each behind its own lock, with its share of the byte budget
+#define FC_CACHE_MAX_ENTRY_SHARE (4) // a response over 1/4 of a shard budget is not kept
+
+namespace fc {
+
+struct response_cache::store {
+public:
+  struct entry {
+    std::string m_key;
+    std::shared_ptr<const std::string> m_message; // see 'response::m_serialized'
+    size_t m_head;
+    uint64_t m_expires; // ns
+  };
+
+  // entries most recently used first, the map points into the list
+  struct alignas(64) shard {
+  public:
+    std::mutex m_mutex;
+    std::list<entry> m_lru;
+    std::unordered_map<std::string_view, std::list<entry>::iterator> m_index;
+    size_t m_bytes = 0;
+    // written under the lock, read from anywhere
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+    std::atomic<uint64_t> m_evictions{0};
+
+    void erase(std::list<entry>::iterator);
+  };
+
+  uint64_t m_ttl; // ns
+  size_t m_shard_budget;
+  std::vector<std::string> m_vary;
+  std::string m_name;
+  std::unique_ptr<shard[]> m_shards;
+
+  store(unsigned ttl_ms, size_t max_bytes, std::vector<std::string> vary, std::string name);
+  ~store();
+
+  shard &shard_of(std::string_view key);
+  // message kept for 'key' and the size of its head, null when there is none still fresh at 'now'
+  std::shared_ptr<const std::string> find(const std::string &key, uint64_t now, size_t *head);
+  void insert(std::string key, std::shared_ptr<const std::string> message, size_t head, uint64_t now);
+  size_t invalidate(std::string_view prefix);
+  uint64_t total(std::atomic<uint64_t> shard::*counter) const;
+};
+
+// Lookup key of 'req': its path with repeated and trailing slashes dropped, its query string, then
+// the value of each header in 'vary'
+std::string cache_key(const request &req, const std::vector<std::string> &vary);
+
+// Counters of every cache alive in Prometheus text format, appended to 'out'
+void render_cache_metrics(std::string &out);
+
+} // namespace fc
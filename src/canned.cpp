@@ -0,0 +1,71 @@
+#include <array>
+#include <string>
+#include <string_view>
+
+#include "canned.hpp"
+#include "http.hpp"
+#include "include/fc.hpp"
+#include "templates.hpp"
+
+#define FC_RETRY_AFTER "1" // seconds a client refused with 429 or 503 is asked to wait before trying again
+
+namespace fc {
+
+namespace {
+
+constexpr std::array<status, 10> CANNED = {status::BAD_REQUEST, status::NOT_FOUND, status::METHOD_NOT_ALLOWED, status::REQUEST_TIMEOUT, status::PAYLOAD_TOO_LARGE, status::TOO_MANY_REQUESTS, status::REQUEST_HEADER_FIELDS_TOO_LARGE, status::INTERNAL_SERVER_ERROR, status::NOT_IMPLEMENTED, status::SERVICE_UNAVAILABLE};
+constexpr size_t NMASKS = 1u << static_cast<int>(method::COUNT);
+constexpr size_t NCONN = static_cast<size_t>(conn_header::COUNT);
+
+const char *const CONN_LINES[NCONN] = {"", templates::CONNECTION_CLOSE, templates::CONNECTION_KEEP_ALIVE};
+
+// the connection header goes last, right before the blank line, as 'write_head' puts it
+std::string serialize(const response &res, conn_header conn) {
+  std::string message = res.to_string();
+  message.insert(message.find("\r\n\r\n") + 2, CONN_LINES[static_cast<size_t>(conn)]);
+  return message;
+}
+
+struct canned_table {
+public:
+  std::array<std::array<std::string, NCONN>, CANNED.size()> m_messages;
+  std::array<std::array<std::string, NCONN>, NMASKS> m_not_allowed;
+
+  canned_table() {
+    for (size_t i = 0; i < CANNED.size(); i++) {
+      response res = response::ok(CANNED[i]);
+      // refusals under load, see 'worker::should_shed' and 'rate_limit'
+      if (status::SERVICE_UNAVAILABLE == CANNED[i] || status::TOO_MANY_REQUESTS == CANNED[i]) res.set_header("Retry-After", FC_RETRY_AFTER);
+      for (size_t c = 0; c < NCONN; c++) m_messages[i][c] = serialize(res, static_cast<conn_header>(c));
+    }
+    for (size_t mask = 0; mask < NMASKS; mask++) {
+      std::string allow;
+      for (int m = 0; m < static_cast<int>(method::COUNT); m++) {
+        if (!(mask & (1u << m))) continue;
+        if (!allow.empty()) allow.append(", ");
+        allow.append(method_to_string(static_cast<method>(m)));
+      }
+      response res = response::ok(status::METHOD_NOT_ALLOWED);
+      res.set_header("Allow", allow);
+      for (size_t c = 0; c < NCONN; c++) m_not_allowed[mask][c] = serialize(res, static_cast<conn_header>(c));
+    }
+  }
+};
+
+const canned_table &table() {
+  static const canned_table instance;
+  return instance;
+}
+
+} // namespace
+
+std::string_view canned_response(status s, conn_header conn) {
+  for (size_t i = 0; i < CANNED.size(); i++) {
+    if (CANNED[i] == s) return table().m_messages[i][static_cast<size_t>(conn)];
+  }
+  return {};
+}
+
+std::string_view canned_not_allowed(unsigned allowed, conn_header conn) { return table().m_not_allowed[allowed % NMASKS][static_cast<size_t>(conn)]; }
+
+} // namespace fc
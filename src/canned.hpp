@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string_view>
+
+#include "include/fc.hpp"
+
+namespace fc {
+
+// Connection header carried by a canned message, see 'worker::send_response'
+enum class conn_header { NONE, CLOSE, KEEP_ALIVE, COUNT };
+
+// Whole messages, head and body, for the errors the worker answers by itself (400, 404, 405, 408,
+// 413, 431, 500, 501 and 503) or a handler through 'response::canned' (429). Serialized once on
+// first use and only read afterwards, sending one formats nothing. The 429 and 503 carry a
+// Retry-After header. Empty for any other status.
+std::string_view canned_response(status, conn_header);
+// 405 whose Allow header lists the methods set in 'allowed' (bit 'method' for each of them)
+std::string_view canned_not_allowed(unsigned allowed, conn_header);
+
+} // namespace fc
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+#define FC_SHED_INTERVAL (100) // ms, window over which the smallest queue delay is looked at
+
+namespace fc {
+
+// CoDel applied to requests rather than packets. A queue only holding a burst drains and sees
+// some request go through quickly, one that stays above 'target' for a whole interval even at its
+// best is standing and the loop is overloaded. Until an interval brings the delay back down,
+// requests that waited more than twice the target are refused, they would likely be answered
+// after the client gave up anyway.
+struct codel {
+public:
+  uint64_t m_target;       // ns
+  uint64_t m_interval;     // ns
+  uint64_t m_interval_end; // ns, when the current interval is judged
+  uint64_t m_min_delay;    // ns, smallest delay seen during the current interval
+  bool m_overloaded;
+
+  codel(uint64_t target_ns, uint64_t interval_ns) : m_target(target_ns), m_interval(interval_ns), m_interval_end(0), m_min_delay(UINT64_MAX), m_overloaded(false) {}
+
+  // whether a request that waited 'delay' before being dispatched at 'now' is refused
+  bool shed(uint64_t delay, uint64_t now) {
+    if (now >= m_interval_end) {
+      // an interval without any request says nothing about the queue
+      if (m_min_delay != UINT64_MAX) m_overloaded = m_min_delay > m_target;
+      m_min_delay = UINT64_MAX;
+      m_interval_end = now + m_interval;
+    }
+    if (delay < m_min_delay) m_min_delay = delay;
+    return m_overloaded && delay > 2 * m_target;
+  }
+};
+
+} // namespace fc
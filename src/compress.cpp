@@ -0,0 +1,148 @@
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <zlib.h>
+
+#include "compress.hpp"
+#include "include/fc.hpp"
+#include "req.hpp"
+
+namespace fc {
+
+namespace {
+
+std::string_view trim(std::string_view str) {
+  while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) str.remove_prefix(1);
+  while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) str.remove_suffix(1);
+  return str;
+}
+
+// value of the line named 'name' in a block of "Name: value\r\n" lines, a view into 'lines'
+std::optional<std::string_view> find_header(std::string_view lines, std::string_view name) {
+  while (!lines.empty()) {
+    size_t eol = lines.find("\r\n");
+    std::string_view line = lines.substr(0, eol);
+    lines.remove_prefix(eol == std::string_view::npos ? lines.size() : eol + 2);
+    size_t colon = line.find(':');
+    if (colon != std::string_view::npos && iequals(trim(line.substr(0, colon)), name)) return trim(line.substr(colon + 1));
+  }
+  return std::nullopt;
+}
+
+bool has_header(std::string_view lines, std::string_view name) { return find_header(lines, name).has_value(); }
+
+// whether a comma separated list has 'token' in it, compared case-insensitively
+bool lists(std::string_view list, std::string_view token) {
+  while (!list.empty()) {
+    size_t comma = list.find(',');
+    if (iequals(trim(list.substr(0, comma)), token)) return true;
+    list.remove_prefix(comma == std::string_view::npos ? list.size() : comma + 1);
+  }
+  return false;
+}
+
+// media types made of text, binary formats (images, archives, fonts) are compressed already
+bool compressible(std::string_view type) {
+  type = trim(type.substr(0, type.find(';')));
+  if (type.starts_with("text/")) return true;
+  for (std::string_view suffix : {"json", "javascript", "xml", "ecmascript"}) {
+    if (type.ends_with(suffix)) return true;
+  }
+  return false;
+}
+
+} // namespace
+
+content_coding negotiate_coding(std::string_view header) {
+  // -1 until listed
+  double gzip = -1, deflate = -1, any = -1;
+  while (!header.empty()) {
+    size_t comma = header.find(',');
+    std::string_view item = header.substr(0, comma);
+    header.remove_prefix(comma == std::string_view::npos ? header.size() : comma + 1);
+    size_t semicolon = item.find(';');
+    std::string_view coding = trim(item.substr(0, semicolon));
+    double q = 1;
+    if (semicolon != std::string_view::npos) {
+      std::string_view param = trim(item.substr(semicolon + 1));
+      if (param.starts_with("q=") || param.starts_with("Q=")) q = std::strtod(std::string(param.substr(2)).c_str(), nullptr);
+    }
+    if (iequals(coding, "gzip") || iequals(coding, "x-gzip")) gzip = q;
+    else if (iequals(coding, "deflate")) deflate = q;
+    else if (coding == "*") any = q;
+  }
+  if (gzip < 0) gzip = any;
+  if (deflate < 0) deflate = any;
+  if (gzip <= 0 && deflate <= 0) return content_coding::IDENTITY;
+  return gzip >= deflate ? content_coding::GZIP : content_coding::DEFLATE;
+}
+
+bool compression::eligible(const response &res, size_t min_size) {
+  if (res.m_file || res.m_pending || res.m_stream || res.m_canned || res.m_serialized) return false;
+  int code = static_cast<int>(res.m_status);
+  if (code < 200 || res.m_status == status::NO_CONTENT || res.m_status == status::PARTIAL_CONTENT || res.m_status == status::NOT_MODIFIED) return false;
+  std::string_view type = res.m_content_type;
+  if (res.m_content_type_line) {
+    type = res.m_content_type_line;
+    type.remove_prefix(type.find(':') + 1);
+    type = type.substr(0, type.find('\r'));
+  }
+  if (!compressible(type)) return false;
+  if (res.content_length() < min_size) return false;
+  return !has_header(res.m_headers, "Content-Encoding");
+}
+
+bool compression::apply(response &res, content_coding coding, int level) {
+  if (coding == content_coding::IDENTITY) return false;
+  z_stream zs{};
+  // 16 added to the window bits asks for a gzip wrapper, "deflate" means the zlib one (RFC 9110)
+  int window_bits = coding == content_coding::GZIP ? 15 + 16 : 15;
+  if (deflateInit2(&zs, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+
+  auto out = std::make_shared<std::string>();
+  out->resize(deflateBound(&zs, res.content_length()));
+  zs.next_out = (Bytef *)out->data();
+  zs.avail_out = out->size();
+  int result = Z_OK;
+  for (size_t i = 0; i <= res.m_body.size() && result == Z_OK; i++) {
+    bool last = i == res.m_body.size();
+    zs.next_in = last ? nullptr : (Bytef *)res.m_body[i].m_data.data();
+    zs.avail_in = last ? 0 : res.m_body[i].m_data.size();
+    do {
+      if (0 == zs.avail_out) {
+        // the bound holds for a single call, a body in many segments may go a bit past it
+        size_t used = out->size();
+        out->resize(used * 2);
+        zs.next_out = (Bytef *)out->data() + used;
+        zs.avail_out = out->size() - used;
+      }
+      result = deflate(&zs, last ? Z_FINISH : Z_NO_FLUSH);
+    } while (result == Z_OK && (last || zs.avail_in));
+  }
+  deflateEnd(&zs);
+  if (result != Z_STREAM_END) return false;
+
+  out->resize(zs.total_out);
+  res.m_body.clear();
+  res.m_body.push_back({*out, std::move(out)});
+  res.set_header("Content-Encoding", coding == content_coding::GZIP ? "gzip" : "deflate");
+  add_vary(res);
+  // the identity body has the same strong validator, a Range request or If-Range must not mix up
+  // the bytes of the two, a weak one still answers If-None-Match for both
+  if (auto etag = find_header(res.m_headers, "ETag"); etag && !etag->starts_with("W/")) {
+    res.m_headers.insert(etag->data() - res.m_headers.data(), "W/");
+  }
+  return true;
+}
+
+void compression::add_vary(response &res) {
+  auto vary = find_header(res.m_headers, "Vary");
+  if (!vary) return res.set_header("Vary", "Accept-Encoding");
+  // varying on everything covers it already
+  if (lists(*vary, "*") || lists(*vary, "Accept-Encoding")) return;
+  res.m_headers.insert(vary->data() + vary->size() - res.m_headers.data(), ", Accept-Encoding");
+}
+
+} // namespace fc
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+#include "include/fc.hpp"
+
+#define FC_COMPRESSION_MIN_SIZE (1024)             // 1 KB, smaller bodies barely shrink and cost a deflate setup
+#define FC_COMPRESSION_OFFLOAD_SIZE (1024 * 256)   // 256 KB, larger bodies are compressed on the thread pool
+
+namespace fc {
+
+enum class content_coding { IDENTITY, GZIP, DEFLATE };
+
+// Coding picked from an Accept-Encoding header: the one of gzip and deflate with the highest
+// q-value, gzip on a tie, "*" standing for both when they are not listed. IDENTITY when neither is
+// acceptable.
+content_coding negotiate_coding(std::string_view accept_encoding);
+
+struct compression {
+public:
+  // Whether compressing 'res' is worth it: no file part, no coding applied already, a status that
+  // carries a body, a textual content type and at least 'min_size' bytes of body.
+  static bool eligible(const response &res, size_t min_size);
+  // Deflates the body segments into a single one with 'level' (1 to 9), then sets Content-Encoding,
+  // adds Accept-Encoding to Vary and makes a strong ETag weak. Returns false, leaving 'res'
+  // untouched, when zlib failed.
+  static bool apply(response &res, content_coding coding, int level);
+  // Adds Accept-Encoding to Vary, to an existing header unless listed already or "*", for the
+  // responses that could have been compressed but were not because of the request
+  static void add_vary(response &res);
+};
+
+} // namespace fc
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <uv.h>
+
+#include "arena.hpp"
+#include "compress.hpp"
+#include "http.hpp"
+#include "include/fc.hpp"
+#include "stream.hpp"
+#include "timer.hpp"
+
+namespace fc {
+
+struct write_ctx;
+
+struct connection {
+public:
+  // Must stay the first member, libuv callbacks hand us a 'uv_tcp_t *' which is cast back to 'connection *'
+  uv_tcp_t m_handle;
+  http_parser m_parser;
+  // in the worker timer wheel while some timeout applies, 'm_data' points back here
+  timer_entry m_timer;
+
+  // Bytes read from the socket, a slab of the worker read pool. Once every complete message in it
+  // was answered the unfinished one (if any) is moved to the front, the slab goes back to the pool
+  // when nothing is left in it.
+  char *m_inbuf;
+  size_t m_inbuf_cap;
+  size_t m_inbuf_len;
+  size_t m_inbuf_parsed;   // bytes already fed to the parser
+  size_t m_inbuf_answered; // bytes of the messages answered so far, while a deferred request waits
+  // When a body outgrows the slab holding its request head, that slab is chained here (the head
+  // views still point into it) and reading goes on in a fresh slab, the body being copied out.
+  char *m_head_buf;
+  size_t m_head_cap;
+  size_t m_head_len;
+  // request being filled by the parser, its views point into 'm_inbuf' and its state lives in 'm_arena'
+  std::optional<request> m_req;
+  arena m_arena;
+
+  // Response whose file part is being sent with 'uv_fs_sendfile', responses scheduled meanwhile wait
+  // in 'm_outq' so they still reach the client in order. The connection outlives the sendfile.
+  write_ctx *m_file_ctx;
+  std::deque<write_ctx *> m_outq;
+  // body of the response being streamed, the connection stays deferred until it ended
+  std::shared_ptr<body_stream::state> m_stream;
+
+  unsigned m_nrequests;        // requests parsed on this connection so far
+  size_t m_peer_hash;          // of the peer address, looked up the first time 'rate_limit' needs it
+  // metrics of the request being answered, copied into its response write
+  unsigned m_route;
+  uint64_t m_started; // ns, when it was routed
+  uint64_t m_read_at; // ns, loop time of the last read (ms resolution), only kept while shedding on queue delay
+  size_t m_bytes_in;
+  unsigned char m_http_minor; // version of the request being answered
+  content_coding m_coding;    // negotiated for the request being answered, when compression is on
+  unsigned m_pending_writes;  // responses handed to 'uv_write' but not flushed yet
+  unsigned m_open_handles;    // handles to be closed before the connection can be freed
+  bool m_keep_alive;          // false once the last response was scheduled, no more requests are read
+  // a handler called 'request::defer', nothing else is parsed until its response comes in
+  bool m_deferred;
+  bool m_closing;
+  bool m_in_flight; // a request was dispatched and its response isn't out yet, see 'worker::m_in_flight'
+
+  connection(size_t max_header_size, size_t max_body_size, buffer_pool *pool)
+      : m_parser(max_header_size, max_body_size), m_timer(), m_inbuf(nullptr), m_inbuf_cap(0), m_inbuf_len(0), m_inbuf_parsed(0), m_inbuf_answered(0), m_head_buf(nullptr), m_head_cap(0), m_head_len(0), m_req(), m_arena(pool), m_file_ctx(nullptr), m_outq(), m_stream(), m_nrequests(0), m_peer_hash(0), m_route(0), m_started(0), m_read_at(0), m_bytes_in(0), m_http_minor(1), m_coding(content_coding::IDENTITY), m_pending_writes(0), m_open_handles(0), m_keep_alive(true), m_deferred(false), m_closing(false), m_in_flight(false) {}
+};
+
+} // namespace fc
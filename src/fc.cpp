@@ -1,49 +1,38 @@
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <string>
-#include <string_view>
+#include <thread>
 #include <uv.h>
 #include <vector>
 
-#include "external/llhttp/llhttp.h"
-
-#include "http.hpp"
 #include "include/fc.hpp"
-#include "req.hpp"
+#include "metrics.hpp"
 #include "router.hpp"
+#include "static.hpp"
 #include "utils.hpp"
-
-#define FC_BACKLOG (128)
-#define MAX_REQ_LEN (1024 * 1024 * 5) // 5 MB
+#include "worker.hpp"
 
 namespace fc {
 
 struct app::impl {
 public:
   root_router m_router;
-  http_parser m_http_parser;
+  settings m_settings;
+  std::vector<std::unique_ptr<worker>> m_workers;
+  // counters of every worker, read by the metrics route
+  std::vector<const worker_stats *> m_stats;
+  // run before those of the route, the last one added last as 'router::m_midwares'
+  std::vector<path_handler> m_midwares;
 
-  // The 'm_loop->data' field always holds a pointer to an object of this struct
-  uv_loop_t *m_loop;
-  uv_tcp_t m_host_sock;
-  struct sockaddr_in m_addr;
-
-  impl() : m_router(), m_http_parser(), m_loop(uv_default_loop()) {
-    m_loop->data = this;
-    uv_tcp_init(m_loop, &m_host_sock);
-  }
-
-  void parse_http_request(request);
-  void match_request_to_handler(request);
-  void send_response(request, response);
+  impl() : m_router(), m_settings(), m_workers(), m_stats(), m_midwares() {}
+  ~impl();
 
   void add_route(method, const std::string, path_handler, const std::vector<path_handler> &);
-
-  // uv callbacks
-  static void on_connection(uv_stream_t *server, int status);
-  static void on_alloc_buf(uv_handle_t *client, size_t size, uv_buf_t *buf);
-  static void on_read_buf(uv_stream_t *client, long nread, const uv_buf_t *buf);
-  static void on_write_response(uv_write_t *req, int status);
-  static void on_close_conn(uv_handle_t *client);
+  // stops and drops every worker, waiting for those running on their own thread
+  void close_workers();
 };
 
 app::app() : m_pimpl(new app::impl()) {}
@@ -75,94 +64,154 @@ void app::use(const router &router) {
   }
 }
 
-int app::listen(const std::string addr, std::function<void(const std::string &)> call_back) {
-  auto [host, port] = split_address(addr);
-  uv_ip4_addr(host.c_str(), std::stoi(port), &m_pimpl->m_addr);
-  int result = uv_tcp_bind(&m_pimpl->m_host_sock, (const struct sockaddr *)&m_pimpl->m_addr, 0);
-  if (result) {
-    std::cerr << "[FALCON ERROR]: Failed to bind at " << addr << ", " << uv_strerror(result) << std::endl;
-    return -1;
-  }
-  result = uv_listen((uv_stream_t *)&m_pimpl->m_host_sock, FC_BACKLOG, app::impl::on_connection);
-  if (result) {
-    std::cerr << "[FALCON ERROR]: Failed to listen at " << addr << ", " << uv_strerror(result) << std::endl;
-    return -1;
-  }
-  call_back(host + ":" + port);
-  return uv_run(m_pimpl->m_loop, UV_RUN_DEFAULT);
+void app::use(path_handler midware) {
+  m_pimpl->m_midwares.insert(m_pimpl->m_midwares.begin(), midware);
 }
 
-void app::impl::on_connection(uv_stream_t *host, int status) {
-  if (status < 0) {
-    std::cerr << "[FALCON ERROR]: Failed to accept new connection, " << uv_strerror(status) << std::endl;
-    return;
-  }
-  uv_tcp_t *remote = new uv_tcp_t;
-  uv_tcp_init(host->loop, remote);
-  int result = uv_accept(host, (uv_stream_t *)remote);
-  if (result != 0) {
-    std::cerr << "[FALCON ERROR]: Failed to accept new connection, " << uv_strerror(result) << std::endl;
-    return;
-  }
-  uv_read_start((uv_stream_t *)remote, app::impl::on_alloc_buf, app::impl::on_read_buf);
+void app::serve_static(const std::string prefix, const std::filesystem::path dir) {
+  path_handler handler = static_handler(prefix, dir);
+  m_pimpl->add_route(method::GET, prefix, handler, {});
+  m_pimpl->add_route(method::GET, prefix + "/*", handler, {});
 }
 
-void app::impl::on_alloc_buf(uv_handle_t *client, size_t size, uv_buf_t *buf) {
-  buf->len = size;
-  buf->base = new char[size];
+void app::use_static(static_dispatch dispatch, std::vector<std::pair<method, std::string_view>> routes) {
+  m_pimpl->m_router.add_static(dispatch, routes);
 }
 
-void app::impl::on_read_buf(uv_stream_t *client, long nread, const uv_buf_t *buf) {
-  uv_read_stop(client);
-  if (nread < 0) {
-    if (nread != UV_EOF)
-      std::cerr << "[FALCON ERROR]: Failed to read remote socket, " << uv_strerror(nread) << std::endl;
-    delete[] buf->base;
-    uv_close((uv_handle_t *)client, app::impl::on_close_conn);
-    return;
-  }
-  ((app::impl *)client->loop->data)->parse_http_request(request_factory((void *)client, std::string_view(buf->base, strnlen(buf->base, MAX_REQ_LEN))));
+void app::expose_metrics(const std::string path) {
+  m_pimpl->m_settings.m_metrics = true;
+  m_pimpl->add_route(method::GET, path, metrics::handler(&m_pimpl->m_router.m_route_names, &m_pimpl->m_stats), {});
 }
 
-void app::impl::parse_http_request(request req) {
-  enum llhttp_errno err = m_http_parser.parse(&req);
-  if (HPE_OK != err && HPE_INVALID_METHOD != err) {
-    // send 'bad request' response
-    std::cerr << "[FALCON ERROR]: Faild to parse request, " << llhttp_errno_name(err) << std::endl;
-    return;
-  }
-  match_request_to_handler(std::move(req));
+void app::set_keep_alive_timeout(unsigned ms) {
+  m_pimpl->m_settings.m_keep_alive_timeout = ms;
 }
 
-void app::impl::match_request_to_handler(request req) {
-  if (m_router.match(req)) {
-    auto res = req.next();
-    return send_response(std::move(req), std::move(res));
-  }
-  std::cout << "No match\n";
+void app::set_header_timeout(unsigned ms) {
+  m_pimpl->m_settings.m_header_timeout = ms;
 }
 
-void app::impl::send_response(request req, response res) {
-  uv_buf_t *write_buf = new uv_buf_t;
-  *write_buf = uv_buf_init((char *)res.to_string().c_str(), res.to_string().length());
-  uv_write_t *write_req = new uv_write_t;
-  write_req->data = (void *)req.get_raw().data();
-  uv_write(write_req, (uv_stream_t *)req.get_remote(), write_buf, 1, app::impl::on_write_response);
+void app::set_body_timeout(unsigned ms) {
+  m_pimpl->m_settings.m_body_timeout = ms;
 }
 
-void app::impl::add_route(method method, const std::string path, path_handler handler, const std::vector<path_handler> &midwares) {
-  m_router.add(method, path, handler, midwares);
+void app::set_write_timeout(unsigned ms) {
+  m_pimpl->m_settings.m_write_timeout = ms;
+}
+
+void app::set_backlog(int backlog) {
+  m_pimpl->m_settings.m_backlog = backlog;
+}
+
+void app::set_max_connections(unsigned n) {
+  m_pimpl->m_settings.m_max_connections = n;
+}
+
+void app::set_max_in_flight(unsigned n) {
+  m_pimpl->m_settings.m_max_in_flight = n;
+}
+
+void app::set_shed_target(unsigned ms) {
+  m_pimpl->m_settings.m_shed_target = ms;
+}
+
+void app::set_max_requests_per_connection(unsigned n) {
+  m_pimpl->m_settings.m_max_requests_per_conn = n;
+}
+
+void app::set_max_header_size(size_t size) {
+  m_pimpl->m_settings.m_max_header_size = size;
+}
+
+void app::set_max_body_size(size_t size) {
+  m_pimpl->m_settings.m_max_body_size = size;
+}
+
+void app::set_max_json_size(size_t size) {
+  m_pimpl->m_settings.m_max_json_size = size;
+}
+
+void app::set_max_json_depth(unsigned depth) {
+  m_pimpl->m_settings.m_max_json_depth = depth;
+}
+
+void app::set_compression_level(int level) {
+  m_pimpl->m_settings.m_compression_level = level;
+}
+
+void app::set_compression_min_size(size_t size) {
+  m_pimpl->m_settings.m_compression_min_size = size;
 }
 
-void app::impl::on_write_response(uv_write_t *req, int status) {
-  delete[] (char *)req->data;
-  delete req->bufs;
-  delete req;
-  uv_close((uv_handle_t *)req->handle, app::impl::on_close_conn);
+void app::set_compression_offload_size(size_t size) {
+  m_pimpl->m_settings.m_compression_offload_size = size;
 }
 
-void app::impl::on_close_conn(uv_handle_t *client) {
-  delete client;
+void app::set_offload_threads(unsigned n) {
+  m_pimpl->m_settings.m_offload_threads = n;
 }
 
+int app::listen(const std::string addr, std::function<void(const std::string &)> call_back, unsigned nworkers) {
+  if (0 == nworkers) nworkers = std::max(1u, std::thread::hardware_concurrency());
+  // a peer closing its end must fail the write (or sendfile) in progress, not kill the process
+  signal(SIGPIPE, SIG_IGN);
+  // read by libuv when its thread pool starts, on the first offloaded work or file operation
+  if (m_pimpl->m_settings.m_offload_threads) {
+    setenv("UV_THREADPOOL_SIZE", std::to_string(m_pimpl->m_settings.m_offload_threads).c_str(), 1);
+  }
+  auto [host, port] = split_address(addr);
+  struct sockaddr_in sock_addr;
+  uv_ip4_addr(host.c_str(), std::stoi(port), &sock_addr);
+  for (unsigned i = 0; i < nworkers; ++i) {
+    // the first worker keeps running on the default loop, in the calling thread
+    uv_loop_t *loop = uv_default_loop();
+    int result = loop ? 0 : UV_ENOMEM;
+    if (i > 0) {
+      loop = new uv_loop_t;
+      if ((result = uv_loop_init(loop))) delete loop;
+    }
+    if (0 == result) {
+      auto &w = m_pimpl->m_workers.emplace_back(std::make_unique<worker>(loop, m_pimpl->m_router, m_pimpl->m_settings));
+      m_pimpl->m_stats.push_back(&w->m_stats);
+      result = w->bind((const struct sockaddr *)&sock_addr, nworkers > 1);
+    }
+    if (result) {
+      std::cerr << "[FALCON ERROR]: Failed to listen at " << addr << ", " << uv_strerror(result) << std::endl;
+      // the workers bound so far would keep their sockets, and their loops could not be closed
+      m_pimpl->close_workers();
+      return -1;
+    }
+  }
+  for (unsigned i = 1; i < nworkers; ++i) {
+    worker *w = m_pimpl->m_workers[i].get();
+    w->m_thread = std::thread([w] { w->run(); });
+  }
+  call_back(host + ":" + port);
+  return m_pimpl->m_workers.front()->run();
+}
+
+void app::impl::add_route(method method, const std::string path, path_handler handler, const std::vector<path_handler> &midwares) {
+  if (m_midwares.empty()) return m_router.add(method, path, handler, midwares);
+  // handlers run from the back, the app ones go last to run first
+  std::vector<path_handler> all(midwares);
+  all.insert(all.end(), m_midwares.begin(), m_midwares.end());
+  m_router.add(method, path, handler, all);
+}
+
+void app::impl::close_workers() {
+  for (auto &w : m_workers) {
+    if (w->m_thread.joinable()) w->m_thread.join();
+    // a loop still holding handles can't be closed, uv_loop_close would fail with UV_EBUSY
+    w->close();
+    if (w->m_loop != uv_default_loop()) {
+      uv_loop_close(w->m_loop);
+      delete w->m_loop;
+    }
+  }
+  m_workers.clear();
+  m_stats.clear();
+}
+
+app::impl::~impl() { close_workers(); }
+
 } // namespace fc
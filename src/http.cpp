@@ -1,57 +1,347 @@
+#include <array>
+#include <bit>
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <string>
 #include <string_view>
 
 #include "http.hpp"
+#include "req.hpp"
+#include "scan.hpp"
 
 namespace fc {
 
-enum llhttp_errno http_parser::parse(request *req) {
-  m_llhttp_instance.data = req;
-  enum llhttp_errno err = llhttp_execute(&m_llhttp_instance, req->m_raw.data(), req->m_raw.length());
-  llhttp_reset(&m_llhttp_instance);
+enum llhttp_errno http_parser::execute(request *req, const char *data, size_t len, size_t *nparsed) {
+#if FC_HTTP_FAST_PATH
+  if (!m_in_message && parse_fast(req, data, len, nparsed)) return HPE_PAUSED;
+#endif
+  return execute_llhttp(req, data, len, nparsed);
+}
+
+enum llhttp_errno http_parser::execute_llhttp(request *req, const char *data, size_t len, size_t *nparsed) {
+  m_req = req;
+  enum llhttp_errno err = llhttp_execute(&m_llhttp_instance, data, len);
+  *nparsed = len;
+  if (HPE_PAUSED == err) {
+    // a whole message was parsed, whatever follows belongs to the next (pipelined) request
+    *nparsed = llhttp_get_error_pos(&m_llhttp_instance) - data;
+    llhttp_resume(&m_llhttp_instance);
+  } else if (HPE_OK == err && !m_headers_complete) {
+    m_header_bytes += len;
+    if (m_header_bytes > m_max_header_size) {
+      m_error = status::REQUEST_HEADER_FIELDS_TOO_LARGE;
+      err = HPE_USER;
+    }
+  }
+  m_req = nullptr;
   return err;
 }
 
-int http_parser::llhttp_on_url(llhttp_t *p, const char *at, size_t len) {
-  request *r = (request *)p->data;
-  r->m_path = std::string_view(at, len);
+static inline void rebase_view(std::string_view &view, const char *from, size_t len, const char *to) {
+  if (view.data() >= from && view.data() < from + len) {
+    view = std::string_view(to + (view.data() - from), view.length());
+  }
+}
+
+void http_parser::rebase(request *req, const char *from, size_t len, const char *to) {
+  rebase_view(req->m_path, from, len, to);
+  rebase_view(req->m_raw_body, from, len, to);
+  for (auto &[field, value] : req->m_headers) {
+    rebase_view(field, from, len, to);
+    rebase_view(value, from, len, to);
+  }
+}
+
+// first 'n' bytes of 's' read as one word, so comparing a method is a mask and a compare
+static constexpr uint64_t word(std::string_view s, size_t n) {
+  uint64_t w = 0;
+  for (size_t i = 0; i < n; i++) {
+    size_t shift = std::endian::native == std::endian::little ? i * 8 : (7 - i) * 8;
+    w |= uint64_t(static_cast<unsigned char>(s[i])) << shift;
+  }
+  return w;
+}
+
+static constexpr uint64_t mask(size_t n) { return word("\xff\xff\xff\xff\xff\xff\xff\xff", n); }
+
+// (mask, word) of the method and the space after it
+struct method_word {
+  uint64_t m_mask;
+  uint64_t m_word;
+  size_t m_len;
+  method m_method;
+};
+
+static constexpr std::array<method_word, 5> METHOD_WORDS = {{
+    {mask(4), word("GET ", 4), 4, method::GET},
+    {mask(5), word("POST ", 5), 5, method::POST},
+    {mask(4), word("PUT ", 4), 4, method::PUT},
+    {mask(7), word("DELETE ", 7), 7, method::DELETE},
+    {mask(6), word("PATCH ", 6), 6, method::PATCH},
+}};
+
+// length of the method at 'p' including the space after it, 0 for a method left to llhttp
+static inline size_t decode_method(const char *p, method *m) {
+  uint64_t w;
+  memcpy(&w, p, sizeof(w));
+  for (const method_word &mw : METHOD_WORDS) {
+    if ((w & mw.m_mask) == mw.m_word) {
+      *m = mw.m_method;
+      return mw.m_len;
+    }
+  }
+  return 0;
+}
+
+// tchar of RFC 9110
+static constexpr std::array<bool, 256> TOKEN = [] {
+  std::array<bool, 256> t{};
+  for (int c = '0'; c <= '9'; c++) t[c] = true;
+  for (int c = 'a'; c <= 'z'; c++) t[c] = t[c - 'a' + 'A'] = true;
+  for (char c : std::string_view("!#$%&'*+-.^_`|~")) t[static_cast<unsigned char>(c)] = true;
+  return t;
+}();
+
+bool http_parser::parse_fast(request *req, const char *data, size_t len, size_t *nparsed) {
+  const char *p = data, *end = data + len;
+  // shortest message is "GET / HTTP/1.1\r\n\r\n"
+  if (len < 18) return false;
+  method m;
+  size_t method_len = decode_method(p, &m);
+  if (!method_len) return false;
+  p += method_len;
+
+  // origin form only, absolute urls and '*' are left to llhttp
+  const char *url = p;
+  if (*url != '/') return false;
+  p = scan::find_unprintable(p, end, 0x21);
+  if (end - p < 11 || *p != ' ') return false;
+  std::string_view path(url, p - url);
+  p++;
+  if (memcmp(p, "HTTP/1.", 7) != 0 || (p[7] != '0' && p[7] != '1') || p[8] != '\r' || p[9] != '\n') return false;
+  unsigned char http_minor = p[7] - '0';
+  p += 10;
+
+  // same flags as llhttp, so keep-alive is decided the same way
+  bool connection_close = false, connection_keep_alive = false;
+  bool has_length = false;
+  uint64_t content_length = 0;
+  size_t first_header = req->m_headers.size();
+  auto give_up = [&] {
+    req->m_headers.resize(first_header);
+    return false;
+  };
+  for (;;) {
+    if (end - p < 2) return give_up();
+    if (p[0] == '\r') {
+      if (p[1] != '\n') return give_up();
+      p += 2;
+      break;
+    }
+    const char *name = p;
+    while (p < end && TOKEN[static_cast<unsigned char>(*p)]) p++;
+    if (p == name || p == end || *p != ':') return give_up();
+    std::string_view field(name, p - name);
+    p++;
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    const char *value = p;
+    for (;;) {
+      p = scan::find_unprintable(p, end, 0x20);
+      if (p == end || *p != '\t') break;
+      p++;
+    }
+    // llhttp reports empty values and trailing whitespace in ways not worth mimicking, a line
+    // starting with whitespace continues this value (obsolete folding)
+    if (p == value || p[-1] == ' ' || p[-1] == '\t') return give_up();
+    if (end - p < 3 || p[0] != '\r' || p[1] != '\n' || p[2] == ' ' || p[2] == '\t') return give_up();
+    std::string_view val(value, p - value);
+    p += 2;
+
+    switch (field.length()) {
+    case 7: // upgrade
+    case 17: // transfer-encoding
+      if (iequals(field, "upgrade") || iequals(field, "transfer-encoding")) return give_up();
+      break;
+    case 10: // connection
+    case 16: // proxy-connection
+      if (iequals(field, "connection") || iequals(field, "proxy-connection")) {
+        if (iequals(val, "close")) connection_close = true;
+        else if (iequals(val, "keep-alive")) connection_keep_alive = true;
+        else return give_up();
+      }
+      break;
+    case 14: // content-length
+      if (iequals(field, "content-length")) {
+        if (has_length || val.length() > 15) return give_up();
+        for (char c : val) {
+          if (c < '0' || c > '9') return give_up();
+          content_length = content_length * 10 + (c - '0');
+        }
+        has_length = true;
+      }
+      break;
+    }
+    req->m_headers.push_back({field, val});
+  }
+  // llhttp refuses these with the right status
+  if (size_t(p - data) > m_max_header_size) return give_up();
+  if (content_length > m_max_body_size || content_length > size_t(end - p)) return give_up();
+
+  m_header_bytes = 0;
+  m_headers_complete = true;
+  m_copy_body = false;
+  m_error = status::BAD_REQUEST;
+  req->m_method = m;
+  req->m_path = path;
+  if (content_length) req->m_raw_body = std::string_view(p, content_length);
+  req->m_http_minor = http_minor;
+  req->m_keep_alive = http_minor > 0 ? !connection_close : connection_keep_alive;
+  for (size_t i = first_header; i < req->m_headers.size(); i++) req->index_header(i);
+  *nparsed = (p - data) + content_length;
+  return true;
+}
+
+// a span split by a read boundary is reported twice, the second part starts right where the first ended
+static inline bool continues(const std::string_view &view, const char *at) {
+  return view.data() && view.data() + view.length() == at;
+}
+
+// extends 'view' when 'at' continues it, otherwise replaces it
+static inline void append_span(std::string_view &view, const char *at, size_t len) {
+  if (continues(view, at)) {
+    view = std::string_view(view.data(), view.length() + len);
+  } else {
+    view = std::string_view(at, len);
+  }
+}
+
+const llhttp_settings_t &http_parser::llhttp_settings() {
+  static llhttp_settings_t settings = [] {
+    llhttp_settings_t s;
+    llhttp_settings_init(&s);
+    s.on_message_begin = http_parser::llhttp_on_message_begin;
+    s.on_url = http_parser::llhttp_on_url;
+    s.on_body = http_parser::llhttp_on_body;
+    s.on_header_field = http_parser::llhttp_on_header_field;
+    s.on_header_field_complete = http_parser::llhttp_on_header_field_complete;
+    s.on_header_value = http_parser::llhttp_on_header_value;
+    s.on_headers_complete = http_parser::llhttp_on_headers_complete;
+    s.on_message_complete = http_parser::llhttp_on_message_complete;
+    return s;
+  }();
+  return settings;
+}
+
+int http_parser::llhttp_on_message_begin(llhttp_t *p) {
+  http_parser *self = (http_parser *)p->data;
+  self->m_header_bytes = 0;
+  self->m_headers_complete = false;
+  self->m_in_message = true;
+  self->m_copy_body = false;
+  self->m_error = status::BAD_REQUEST;
   return HPE_OK;
 }
 
-int http_parser::llhttp_on_method(llhttp_t *p, const char *at, size_t len) {
-  request *r = (request *)p->data;
-  if (strncmp("GET", at, len) == 0)
-    r->m_method = method::GET;
-  else if (strncmp("POST", at, len) == 0)
-    r->m_method = method::POST;
-  else if (strncmp("PUT", at, len) == 0)
-    r->m_method = method::PUT;
-  else if (strncmp("DELETE", at, len) == 0)
-    r->m_method = method::DELETE;
-  else
-    return HPE_INVALID_METHOD;
+int http_parser::llhttp_on_url(llhttp_t *p, const char *at, size_t len) {
+  request *r = ((http_parser *)p->data)->m_req;
+  append_span(r->m_path, at, len);
   return HPE_OK;
 }
 
 int http_parser::llhttp_on_body(llhttp_t *p, const char *at, size_t len) {
-  request *req = (request *)p->data;
-  req->m_raw_body = std::string_view(at, len);
+  http_parser *self = (http_parser *)p->data;
+  request *req = self->m_req;
+  if (req->m_raw_body.length() + len > self->m_max_body_size) {
+    self->m_error = status::PAYLOAD_TOO_LARGE;
+    return -1;
+  }
+  if (!self->m_copy_body && (req->m_raw_body.empty() || continues(req->m_raw_body, at))) {
+    append_span(req->m_raw_body, at, len);
+    return HPE_OK;
+  }
+  // chunked bodies arrive in pieces separated by chunk headers and large ones span several read
+  // buffers, these are joined in a request owned buffer
+  if (req->m_body_buf.empty()) {
+    req->m_body_buf.reserve(req->m_raw_body.length() + len + ((p->flags & F_CONTENT_LENGTH) ? p->content_length : 0));
+    req->m_body_buf.assign(req->m_raw_body.begin(), req->m_raw_body.end());
+  }
+  req->m_body_buf.insert(req->m_body_buf.end(), at, at + len);
+  req->m_raw_body = std::string_view(req->m_body_buf.data(), req->m_body_buf.size());
   return HPE_OK;
 }
 
 int http_parser::llhttp_on_header_field(llhttp_t *p, const char *at, size_t len) {
-  request *req = (request *)p->data;
-  req->m_headers.push_back({std::string_view(at, len), {}});
+  request *req = ((http_parser *)p->data)->m_req;
+  if (!req->m_headers.empty() && !req->m_headers.back().second.data() && continues(req->m_headers.back().first, at)) {
+    append_span(req->m_headers.back().first, at, len);
+  } else {
+    req->m_headers.push_back({std::string_view(at, len), {}});
+  }
+  return HPE_OK;
+}
+
+// the name may have been reported in pieces, it is whole from here on
+int http_parser::llhttp_on_header_field_complete(llhttp_t *p) {
+  request *req = ((http_parser *)p->data)->m_req;
+  req->index_header(req->m_headers.size() - 1);
   return HPE_OK;
 }
 
 int http_parser::llhttp_on_header_value(llhttp_t *p, const char *at, size_t len) {
-  request *req = (request *)p->data;
-  req->m_headers.back().second = std::string_view(at, len);
+  request *req = ((http_parser *)p->data)->m_req;
+  append_span(req->m_headers.back().second, at, len);
   return HPE_OK;
 }
 
+int http_parser::llhttp_on_headers_complete(llhttp_t *p) {
+  http_parser *self = (http_parser *)p->data;
+  request *req = self->m_req;
+  self->m_headers_complete = true;
+  switch (llhttp_get_method(p)) {
+  case HTTP_GET: req->m_method = method::GET; break;
+  case HTTP_POST: req->m_method = method::POST; break;
+  case HTTP_PUT: req->m_method = method::PUT; break;
+  case HTTP_DELETE: req->m_method = method::DELETE; break;
+  case HTTP_PATCH: req->m_method = method::PATCH; break;
+  default: self->m_error = status::NOT_IMPLEMENTED; return -1;
+  }
+  // a head that arrived in one read never went through the check in 'execute_llhttp'
+  size_t head_size = req->m_path.size();
+  for (const auto &h : req->m_headers) head_size += h.first.size() + h.second.size() + 4;
+  if (head_size > self->m_max_header_size) {
+    self->m_error = status::REQUEST_HEADER_FIELDS_TOO_LARGE;
+    return -1;
+  }
+  // refuse oversized payloads up front instead of buffering them first
+  if ((p->flags & F_CONTENT_LENGTH) && p->content_length > self->m_max_body_size) {
+    self->m_error = status::PAYLOAD_TOO_LARGE;
+    return -1;
+  }
+  return HPE_OK;
+}
+
+int http_parser::llhttp_on_message_complete(llhttp_t *p) {
+  http_parser *self = (http_parser *)p->data;
+  request *req = self->m_req;
+  self->m_in_message = false;
+  req->m_keep_alive = llhttp_should_keep_alive(p);
+  req->m_http_minor = p->http_minor;
+  // stop right after this message, any pipelined request is parsed on the next call
+  return HPE_PAUSED;
+}
+
+const char *method_to_string(method m) {
+  switch (m) {
+  case method::GET: return "GET";
+  case method::POST: return "POST";
+  case method::PUT: return "PUT";
+  case method::DELETE: return "DELETE";
+  case method::PATCH: return "PATCH";
+  default: return "";
+  }
+}
+
 const char *status_to_string(status s) {
   switch (s) {
   // 1xx: Informational
@@ -135,4 +425,16 @@ const char *status_to_string(status s) {
   }
 }
 
+std::string_view status_line(status s) {
+  static const auto lines = [] {
+    std::array<std::string, 600> lines;
+    for (int code = 100; code < 600; code++) {
+      lines[code] = "HTTP/1.1 " + std::to_string(code) + " " + status_to_string(static_cast<status>(code)) + "\r\n";
+    }
+    return lines;
+  }();
+  int code = static_cast<int>(s);
+  return code >= 100 && code < 600 ? std::string_view(lines[code]) : std::string_view(lines[500]);
+}
+
 } // namespace fc
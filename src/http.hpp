@@ -1,34 +1,71 @@
 #pragma once
 
+#include <string_view>
+
 #include "external/llhttp/llhttp.h"
 #include "include/fc.hpp"
 
+// complete messages of the usual shape are parsed without llhttp, see 'http_parser::parse_fast'
+#ifndef FC_HTTP_FAST_PATH
+#define FC_HTTP_FAST_PATH 1
+#endif
+
 namespace fc {
 
+// One instance per connection, fed chunk by chunk as bytes are read. Every span reported by
+// llhttp is recorded as a view into the connection input buffer, spans cut by a read boundary
+// are extended in place once the next chunk is appended right after them, so nothing is reparsed.
 struct http_parser {
 public:
   llhttp_t m_llhttp_instance;
-  llhttp_settings_t m_llhttp_settings;
-
-  http_parser() {
-    llhttp_settings_init(&m_llhttp_settings);
-    m_llhttp_settings.on_url = http_parser::llhttp_on_url;
-    m_llhttp_settings.on_method = http_parser::llhttp_on_method;
-    m_llhttp_settings.on_body = http_parser::llhttp_on_body;
-    m_llhttp_settings.on_header_field = http_parser::llhttp_on_header_field;
-    m_llhttp_settings.on_header_value = http_parser::llhttp_on_header_value;
-    llhttp_init(&m_llhttp_instance, HTTP_REQUEST, &m_llhttp_settings);
+
+  // message being parsed, only valid during 'execute'
+  request *m_req;
+  size_t m_max_header_size;
+  size_t m_max_body_size;
+  size_t m_header_bytes;
+  bool m_headers_complete;
+  // llhttp is inside a message, the fast path only starts new ones
+  bool m_in_message;
+  // set when the bytes being parsed won't outlive the read, the body is then copied into the request
+  bool m_copy_body;
+  // status to answer with when 'execute' fails, set by the callbacks that enforce the limits
+  status m_error;
+
+  http_parser(size_t max_header_size, size_t max_body_size) : m_req(nullptr), m_max_header_size(max_header_size), m_max_body_size(max_body_size), m_header_bytes(0), m_headers_complete(false), m_in_message(false), m_copy_body(false), m_error(status::BAD_REQUEST) {
+    llhttp_init(&m_llhttp_instance, HTTP_REQUEST, &llhttp_settings());
+    m_llhttp_instance.data = this;
   }
 
-  enum llhttp_errno parse(request *);
+  // Feeds 'len' bytes to the state machine, stops right after a complete message (HPE_PAUSED)
+  // and stores in 'nparsed' how many bytes were consumed. HPE_OK means more bytes are needed.
+  enum llhttp_errno execute(request *, const char *data, size_t len, size_t *nparsed);
+  // same as 'execute', without trying the fast path first
+  enum llhttp_errno execute_llhttp(request *, const char *data, size_t len, size_t *nparsed);
+
+  // Parses a whole message found at the start of 'data' when it is a plain one: a known method,
+  // HTTP/1.0 or 1.1, printable ascii everywhere, no folded header and a body given by its
+  // Content-Length if any. Returns false, leaving 'req' untouched, on anything else (including a
+  // message cut short) so the bytes go through llhttp, which produces the same result or an error.
+  bool parse_fast(request *, const char *data, size_t len, size_t *nparsed);
+
+  // moves every view of 'req' that points into [from, from + len) to the same offset from 'to'
+  static void rebase(request *req, const char *from, size_t len, const char *to);
 
+  static const llhttp_settings_t &llhttp_settings();
+  static int llhttp_on_message_begin(llhttp_t *p);
   static int llhttp_on_url(llhttp_t *p, const char *at, size_t len);
-  static int llhttp_on_method(llhttp_t *p, const char *at, size_t len);
   static int llhttp_on_body(llhttp_t *p, const char *at, size_t len);
   static int llhttp_on_header_field(llhttp_t *p, const char *at, size_t len);
+  static int llhttp_on_header_field_complete(llhttp_t *p);
   static int llhttp_on_header_value(llhttp_t *p, const char *at, size_t len);
+  static int llhttp_on_headers_complete(llhttp_t *p);
+  static int llhttp_on_message_complete(llhttp_t *p);
 };
 
 const char *status_to_string(status);
+const char *method_to_string(method);
+// "HTTP/1.1 <code> <reason>\r\n", built once for every status
+std::string_view status_line(status);
 
 } // namespace fc
@@ -0,0 +1,318 @@
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "external/nlohmann/json.hpp"
+#include "include/fc.hpp"
+#include "templates.hpp"
+
+#define FC_JSON_SEGMENT_SIZE (1024 * 16) // 16 KB, a full segment is handed over and a new one started
+
+namespace fc {
+
+namespace {
+
+using json = nlohmann::json;
+
+// Refuses a body too large to parse (413) or nested deeper than 'max_depth' (400), strings are
+// skipped so brackets inside them don't count. Cheaper than nesting the parser in a callback.
+void check_json_limits(std::string_view body, size_t max_size, unsigned max_depth) {
+  if (max_size && body.size() > max_size) throw http_error(status::PAYLOAD_TOO_LARGE, "JSON body too large");
+  if (!max_depth) return;
+  unsigned depth = 0;
+  bool in_string = false;
+  for (size_t i = 0; i < body.size(); i++) {
+    char c = body[i];
+    if (in_string) {
+      if (c == '\\') i++;
+      else if (c == '"') in_string = false;
+    } else if (c == '"') {
+      in_string = true;
+    } else if (c == '[' || c == '{') {
+      if (++depth > max_depth) throw http_error(status::BAD_REQUEST, "JSON body nested too deep");
+    } else if ((c == ']' || c == '}') && depth) {
+      depth--;
+    }
+  }
+}
+
+// SAX handler keeping the values of a few top level members, everything else is only scanned.
+// A value being kept is built in place, 'm_stack' holding the containers still open in it.
+struct field_extractor {
+public:
+  std::initializer_list<std::string_view> m_keys;
+  std::vector<json> &m_values;
+  unsigned m_max_depth;
+  unsigned m_depth = 0;
+  size_t m_missing;
+  // index of the member whose value is being kept, -1 when none
+  ptrdiff_t m_capture = -1;
+  std::vector<json *> m_stack;
+  json::string_t m_key; // of the next value in the innermost kept object
+  bool m_done = false;
+  bool m_too_deep = false;
+
+  field_extractor(std::initializer_list<std::string_view> keys, std::vector<json> &values, unsigned max_depth)
+      : m_keys(keys), m_values(values), m_max_depth(max_depth), m_missing(keys.size()) {}
+
+  bool null() { return value(nullptr); }
+  bool boolean(bool v) { return value(v); }
+  bool number_integer(json::number_integer_t v) { return value(v); }
+  bool number_unsigned(json::number_unsigned_t v) { return value(v); }
+  bool number_float(json::number_float_t v, const json::string_t &) { return value(v); }
+  bool string(json::string_t &v) { return value(std::move(v)); }
+  bool binary(json::binary_t &v) { return value(json::binary(std::move(v))); }
+  bool start_object(size_t) { return open(json::object()); }
+  bool start_array(size_t) { return open(json::array()); }
+  bool end_object() { return close(); }
+  bool end_array() { return close(); }
+
+  bool key(json::string_t &name) {
+    if (m_capture >= 0) {
+      m_key = std::move(name);
+    } else if (1 == m_depth) {
+      size_t i = 0;
+      for (std::string_view wanted : m_keys) {
+        // a repeated member keeps its first value
+        if (wanted == name && m_values[i].is_discarded()) m_capture = i;
+        i++;
+      }
+    }
+    return true;
+  }
+
+  bool parse_error(size_t, const std::string &, const nlohmann::detail::exception &) { return false; }
+
+private:
+  // slot the next kept value goes to
+  json *slot() {
+    if (m_stack.empty()) return &m_values[m_capture];
+    json &parent = *m_stack.back();
+    if (parent.is_array()) {
+      parent.push_back(nullptr);
+      return &parent.back();
+    }
+    return &parent[m_key];
+  }
+
+  bool value(json v) {
+    if (m_capture < 0) return true;
+    *slot() = std::move(v);
+    return m_stack.empty() ? kept() : true;
+  }
+
+  bool open(json container) {
+    if (++m_depth > m_max_depth && m_max_depth) {
+      m_too_deep = true;
+      return false;
+    }
+    if (m_capture < 0) return true;
+    json *target = slot();
+    *target = std::move(container);
+    m_stack.push_back(target);
+    return true;
+  }
+
+  bool close() {
+    m_depth--;
+    if (m_capture < 0) return true;
+    m_stack.pop_back();
+    return m_stack.empty() ? kept() : true;
+  }
+
+  // the value of a wanted member is complete, parsing stops once none is missing
+  bool kept() {
+    m_capture = -1;
+    if (0 == --m_missing) m_done = true;
+    return !m_done;
+  }
+};
+
+} // namespace
+
+const nlohmann::json &request::json() {
+  if (m_json) return *m_json;
+  check_json_limits(m_raw_body, m_max_json_size, m_max_json_depth);
+  auto parsed = std::make_shared<nlohmann::json>(nlohmann::json::parse(m_raw_body, nullptr, false));
+  if (parsed->is_discarded()) throw http_error(status::BAD_REQUEST, "Malformed JSON body");
+  m_json = std::move(parsed);
+  return *m_json;
+}
+
+std::vector<nlohmann::json> request::json_fields(std::initializer_list<std::string_view> keys) const {
+  if (m_max_json_size && m_raw_body.size() > m_max_json_size) throw http_error(status::PAYLOAD_TOO_LARGE, "JSON body too large");
+  // discarded marks the members not found yet, turned into null at the end
+  std::vector<nlohmann::json> values(keys.size(), nlohmann::json(nlohmann::json::value_t::discarded));
+  field_extractor sax(keys, values, m_max_json_depth);
+  if (!nlohmann::json::sax_parse(m_raw_body, &sax) && !sax.m_done) {
+    throw http_error(status::BAD_REQUEST, sax.m_too_deep ? "JSON body nested too deep" : "Malformed JSON body");
+  }
+  for (auto &value : values) {
+    if (value.is_discarded()) value = nullptr;
+  }
+  return values;
+}
+
+json_writer::json_writer(response &res) : m_res(&res), m_stream(), m_after_key(false) {
+  res.m_content_type_line = templates::CONTENT_TYPE_JSON;
+  res.m_body.clear();
+  m_buf.reserve(FC_JSON_SEGMENT_SIZE);
+}
+
+json_writer::json_writer(body_stream stream) : m_res(nullptr), m_stream(std::move(stream)), m_after_key(false) { m_buf.reserve(FC_JSON_SEGMENT_SIZE); }
+
+json_writer::~json_writer() { flush(); }
+
+void json_writer::flush() {
+  if (m_buf.empty()) return;
+  if (m_res) {
+    m_res->append_body(std::move(m_buf));
+  } else {
+    m_stream->write(std::move(m_buf));
+  }
+  m_buf = std::string();
+  m_buf.reserve(FC_JSON_SEGMENT_SIZE);
+}
+
+void json_writer::maybe_flush() {
+  // the segments are only ever concatenated, the cut can fall anywhere
+  if (m_buf.size() >= FC_JSON_SEGMENT_SIZE) flush();
+}
+
+void json_writer::separate() {
+  if (m_after_key) {
+    m_after_key = false;
+    return;
+  }
+  if (m_first.empty()) return;
+  if (!m_first.back()) m_buf.push_back(',');
+  m_first.back() = false;
+}
+
+json_writer &json_writer::begin_object() {
+  separate();
+  m_buf.push_back('{');
+  m_first.push_back(true);
+  return *this;
+}
+
+json_writer &json_writer::end_object() {
+  m_buf.push_back('}');
+  m_first.pop_back();
+  maybe_flush();
+  return *this;
+}
+
+json_writer &json_writer::begin_array() {
+  separate();
+  m_buf.push_back('[');
+  m_first.push_back(true);
+  return *this;
+}
+
+json_writer &json_writer::end_array() {
+  m_buf.push_back(']');
+  m_first.pop_back();
+  maybe_flush();
+  return *this;
+}
+
+json_writer &json_writer::key(std::string_view name) {
+  value(name);
+  m_buf.push_back(':');
+  m_after_key = true;
+  return *this;
+}
+
+json_writer &json_writer::value(std::string_view str) {
+  static constexpr char HEX[] = "0123456789abcdef";
+  separate();
+  m_buf.push_back('"');
+  size_t run = 0; // start of the bytes copied as they are
+  for (size_t i = 0; i < str.size(); i++) {
+    unsigned char c = str[i];
+    if (c >= 0x20 && c != '"' && c != '\\') continue;
+    m_buf.append(str.data() + run, i - run);
+    run = i + 1;
+    m_buf.push_back('\\');
+    switch (c) {
+    case '"': m_buf.push_back('"'); break;
+    case '\\': m_buf.push_back('\\'); break;
+    case '\n': m_buf.push_back('n'); break;
+    case '\r': m_buf.push_back('r'); break;
+    case '\t': m_buf.push_back('t'); break;
+    case '\b': m_buf.push_back('b'); break;
+    case '\f': m_buf.push_back('f'); break;
+    default:
+      m_buf.append("u00");
+      m_buf.push_back(HEX[c >> 4]);
+      m_buf.push_back(HEX[c & 0xf]);
+    }
+  }
+  m_buf.append(str.data() + run, str.size() - run);
+  m_buf.push_back('"');
+  maybe_flush();
+  return *this;
+}
+
+json_writer &json_writer::value(bool b) {
+  separate();
+  m_buf.append(b ? "true" : "false");
+  maybe_flush();
+  return *this;
+}
+
+json_writer &json_writer::value(long long v) {
+  separate();
+  char num[24];
+  auto [end, _] = std::to_chars(num, num + sizeof(num), v);
+  m_buf.append(num, end);
+  maybe_flush();
+  return *this;
+}
+
+json_writer &json_writer::value(unsigned long long v) {
+  separate();
+  char num[24];
+  auto [end, _] = std::to_chars(num, num + sizeof(num), v);
+  m_buf.append(num, end);
+  maybe_flush();
+  return *this;
+}
+
+json_writer &json_writer::value(double v) {
+  // like nlohmann, JSON has no representation for these
+  if (!std::isfinite(v)) return value(nullptr);
+  separate();
+  char num[32];
+  auto [end, _] = std::to_chars(num, num + sizeof(num), v);
+  m_buf.append(num, end);
+  // keeps a whole double a float once parsed back, as nlohmann writes it
+  if (std::string_view(num, end - num).find_first_of(".eE") == std::string_view::npos) m_buf.append(".0");
+  maybe_flush();
+  return *this;
+}
+
+json_writer &json_writer::value(std::nullptr_t) {
+  separate();
+  m_buf.append("null");
+  maybe_flush();
+  return *this;
+}
+
+json_writer &json_writer::value(const nlohmann::json &j) {
+  separate();
+  nlohmann::detail::serializer<nlohmann::json> serializer(nlohmann::detail::output_adapter<char>(m_buf), ' ');
+  serializer.dump(j, false, false, 0);
+  maybe_flush();
+  return *this;
+}
+
+} // namespace fc
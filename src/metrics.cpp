@@ -0,0 +1,152 @@
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cache.hpp"
+#include "metrics.hpp"
+
+namespace fc {
+
+// upper bounds of the exported histogram buckets, in microseconds
+static constexpr std::array<uint64_t, 16> EXPORTED_BUCKETS = {100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000};
+
+struct route_totals {
+  uint64_t m_requests = 0;
+  std::array<uint64_t, 5> m_classes{};
+  uint64_t m_bytes_in = 0;
+  uint64_t m_bytes_out = 0;
+  std::array<uint64_t, latency_histogram::NBUCKETS> m_counts{};
+  uint64_t m_sum = 0;
+
+  void add(const route_stats &stats) {
+    m_requests += stats.m_requests.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < m_classes.size(); i++) m_classes[i] += stats.m_classes[i].load(std::memory_order_relaxed);
+    m_bytes_in += stats.m_bytes_in.load(std::memory_order_relaxed);
+    m_bytes_out += stats.m_bytes_out.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < m_counts.size(); i++) m_counts[i] += stats.m_latency.m_counts[i].load(std::memory_order_relaxed);
+    m_sum += stats.m_latency.m_sum.load(std::memory_order_relaxed);
+  }
+};
+
+static void append_label(std::string &out, std::string_view route) {
+  out.append("{route=\"");
+  for (char c : route) {
+    if (c == '"' || c == '\\') out.push_back('\\');
+    out.push_back(c);
+  }
+  out.push_back('"');
+}
+
+static void append_sample(std::string &out, std::string_view name, std::string_view route, std::string_view extra, uint64_t value) {
+  out.append(name);
+  append_label(out, route);
+  out.append(extra).append("} ").append(std::to_string(value)).push_back('\n');
+}
+
+static void append_seconds(std::string &out, uint64_t us) {
+  char buf[32];
+  int len = std::snprintf(buf, sizeof(buf), "%g", us / 1e6);
+  out.append(buf, len);
+}
+
+static void append_header(std::string &out, std::string_view name, std::string_view type, std::string_view help) {
+  out.append("# HELP ").append(name).append(" ").append(help).append("\n# TYPE ").append(name).append(" ").append(type).push_back('\n');
+}
+
+std::string metrics::render(const std::vector<std::string> &route_names, const std::vector<const worker_stats *> &workers) {
+  std::vector<route_totals> routes(route_names.size() + 1);
+  uint64_t accepted = 0, closed = 0, read_errors = 0, shed = 0, accept_pauses = 0, pool_hits = 0, pool_misses = 0;
+  std::array<uint64_t, static_cast<size_t>(timeout::COUNT) - 1> timeouts{};
+  for (const worker_stats *w : workers) {
+    // closed first, a connection closing in between is then at worst counted as open
+    closed += w->m_closed.load(std::memory_order_relaxed);
+    accepted += w->m_accepted.load(std::memory_order_relaxed);
+    read_errors += w->m_read_errors.load(std::memory_order_relaxed);
+    shed += w->m_shed.load(std::memory_order_relaxed);
+    accept_pauses += w->m_accept_pauses.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < timeouts.size(); i++) timeouts[i] += w->m_timeouts[i].load(std::memory_order_relaxed);
+    if (w->m_read_pool) {
+      pool_hits += w->m_read_pool->m_hits.load(std::memory_order_relaxed);
+      pool_misses += w->m_read_pool->m_misses.load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < w->m_nroutes && i < routes.size(); i++) routes[i].add(w->m_routes[i]);
+  }
+  auto name_of = [&](size_t id) -> std::string_view { return id ? std::string_view(route_names[id - 1]) : "unmatched"; };
+
+  std::string out;
+  append_header(out, "falcon_requests_total", "counter", "Requests answered, by route and status class.");
+  for (size_t id = 0; id < routes.size(); id++) {
+    for (size_t cls = 0; cls < 5; cls++) {
+      if (!routes[id].m_classes[cls]) continue;
+      append_sample(out, "falcon_requests_total", name_of(id), ",code=\"" + std::to_string(cls + 1) + "xx\"", routes[id].m_classes[cls]);
+    }
+  }
+  append_header(out, "falcon_request_bytes_total", "counter", "Bytes of the requests read, head and body.");
+  for (size_t id = 0; id < routes.size(); id++) {
+    if (routes[id].m_requests) append_sample(out, "falcon_request_bytes_total", name_of(id), "", routes[id].m_bytes_in);
+  }
+  append_header(out, "falcon_response_bytes_total", "counter", "Bytes of the responses written, head and body.");
+  for (size_t id = 0; id < routes.size(); id++) {
+    if (routes[id].m_requests) append_sample(out, "falcon_response_bytes_total", name_of(id), "", routes[id].m_bytes_out);
+  }
+
+  // from the request being matched to its response being written, buckets of the internal
+  // histogram are counted under the first exported bound they don't go past
+  append_header(out, "falcon_request_duration_seconds", "histogram", "Time from routing a request to writing its response.");
+  for (size_t id = 0; id < routes.size(); id++) {
+    const route_totals &route = routes[id];
+    if (!route.m_requests) continue;
+    std::string_view name = name_of(id);
+    size_t bucket = 0;
+    uint64_t cumulative = 0;
+    for (uint64_t bound : EXPORTED_BUCKETS) {
+      while (bucket < route.m_counts.size() && latency_histogram::upper_bound(bucket) <= bound) cumulative += route.m_counts[bucket++];
+      std::string le = ",le=\"";
+      append_seconds(le, bound);
+      append_sample(out, "falcon_request_duration_seconds_bucket", name, le + "\"", cumulative);
+    }
+    uint64_t count = 0;
+    for (uint64_t c : route.m_counts) count += c;
+    append_sample(out, "falcon_request_duration_seconds_bucket", name, ",le=\"+Inf\"", count);
+    out.append("falcon_request_duration_seconds_sum");
+    append_label(out, name);
+    out.append("} ");
+    append_seconds(out, route.m_sum);
+    out.push_back('\n');
+    append_sample(out, "falcon_request_duration_seconds_count", name, "", count);
+  }
+
+  auto append_value = [&out](std::string_view name, std::string_view type, std::string_view help, uint64_t value) {
+    append_header(out, name, type, help);
+    out.append(name).append(" ").append(std::to_string(value)).push_back('\n');
+  };
+  append_value("falcon_connections_open", "gauge", "Connections currently open.", accepted > closed ? accepted - closed : 0);
+  append_value("falcon_connections_accepted_total", "counter", "Connections accepted.", accepted);
+  append_value("falcon_connections_closed_total", "counter", "Connections closed.", closed);
+  append_value("falcon_connection_read_errors_total", "counter", "Reads that failed with anything but end of stream.", read_errors);
+  append_value("falcon_requests_shed_total", "counter", "Requests refused with 503 because the loop was overloaded.", shed);
+  append_value("falcon_accept_pauses_total", "counter", "Times a loop stopped accepting connections, having reached its limit.", accept_pauses);
+  append_header(out, "falcon_connection_timeouts_total", "counter", "Connections closed for taking too long, by what they were waiting on.");
+  static constexpr std::array<std::string_view, 4> TIMEOUT_KINDS = {"header", "body", "idle", "write"};
+  for (size_t i = 0; i < timeouts.size(); i++) {
+    out.append("falcon_connection_timeouts_total{kind=\"").append(TIMEOUT_KINDS[i]).append("\"} ").append(std::to_string(timeouts[i])).push_back('\n');
+  }
+  append_value("falcon_read_pool_hits_total", "counter", "Read buffers reused from the pool.", pool_hits);
+  append_value("falcon_read_pool_misses_total", "counter", "Read buffers allocated because the pool was empty or the size unusual.", pool_misses);
+  render_cache_metrics(out);
+  return out;
+}
+
+path_handler metrics::handler(const std::vector<std::string> *route_names, const std::vector<const worker_stats *> *workers) {
+  return [route_names, workers](request &) {
+    response res(status::OK, nullptr);
+    res.set_content_type("text/plain; version=0.0.4");
+    res.append_body(render(*route_names, *workers));
+    return res;
+  };
+}
+
+} // namespace fc
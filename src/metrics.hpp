@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "include/fc.hpp"
+#include "pool.hpp"
+#include "timer.hpp"
+
+#define FC_METRICS_SUB_BITS (3) // 8 buckets per power of two, a recorded latency is off by 12.5% at most
+#define FC_METRICS_MAX_EXP (36) // latencies are clamped below 2^36 us (about 19 hours)
+
+namespace fc {
+
+// Counters have a single writer, the loop owning them, and are read from any thread. A plain
+// store is enough and never locks the bus like an atomic add would.
+inline void bump(std::atomic<uint64_t> &counter, uint64_t n = 1) {
+  counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// Log-linear histogram of latencies in microseconds, as HdrHistogram: values below 2^SUB_BITS
+// have a bucket each, every power of two above is split in 2^SUB_BITS buckets.
+struct latency_histogram {
+public:
+  static constexpr unsigned SUB = 1u << FC_METRICS_SUB_BITS;
+  static constexpr unsigned NBUCKETS = (FC_METRICS_MAX_EXP - FC_METRICS_SUB_BITS + 1) * SUB;
+
+  std::array<std::atomic<uint64_t>, NBUCKETS> m_counts{};
+  std::atomic<uint64_t> m_sum{0}; // us
+
+  static unsigned bucket(uint64_t us) {
+    if (us >= (uint64_t(1) << FC_METRICS_MAX_EXP)) us = (uint64_t(1) << FC_METRICS_MAX_EXP) - 1;
+    if (us < SUB) return us;
+    unsigned exp = 63 - __builtin_clzll(us);
+    unsigned shift = exp - FC_METRICS_SUB_BITS;
+    return (shift + 1) * SUB + (us >> shift) - SUB;
+  }
+
+  // first value past the bucket
+  static uint64_t upper_bound(unsigned bucket) {
+    if (bucket < SUB) return bucket + 1;
+    unsigned shift = bucket / SUB - 1;
+    return (uint64_t(SUB + bucket % SUB) + 1) << shift;
+  }
+
+  void record(uint64_t us) {
+    bump(m_counts[bucket(us)]);
+    bump(m_sum, us);
+  }
+};
+
+// Per route, per worker. Aligned so two workers never write to the same cache line.
+struct alignas(64) route_stats {
+public:
+  std::atomic<uint64_t> m_requests{0};
+  std::array<std::atomic<uint64_t>, 5> m_classes{}; // 1xx to 5xx
+  std::atomic<uint64_t> m_bytes_in{0};
+  std::atomic<uint64_t> m_bytes_out{0};
+  latency_histogram m_latency;
+};
+
+struct alignas(64) worker_stats {
+public:
+  std::atomic<uint64_t> m_accepted{0};
+  std::atomic<uint64_t> m_closed{0};
+  std::atomic<uint64_t> m_read_errors{0};
+  std::atomic<uint64_t> m_shed{0};          // requests refused with 503 under overload
+  std::atomic<uint64_t> m_accept_pauses{0}; // times the connection limit stopped accepting
+  // connections closed by each kind of 'timeout', the first one (none) left out
+  std::array<std::atomic<uint64_t>, static_cast<size_t>(timeout::COUNT) - 1> m_timeouts{};
+  // one slot per route id, see 'root_router::m_route_names', empty while metrics are off
+  std::unique_ptr<route_stats[]> m_routes;
+  size_t m_nroutes = 0;
+  const buffer_pool *m_read_pool = nullptr;
+
+  void enable(size_t nroutes) {
+    m_routes.reset(new route_stats[nroutes]);
+    m_nroutes = nroutes;
+  }
+
+  void record(unsigned route, status status, uint64_t bytes_in, uint64_t bytes_out, uint64_t latency_ns) {
+    route_stats &stats = m_routes[route < m_nroutes ? route : 0];
+    bump(stats.m_requests);
+    unsigned cls = static_cast<unsigned>(status) / 100;
+    if (cls >= 1 && cls <= 5) bump(stats.m_classes[cls - 1]);
+    bump(stats.m_bytes_in, bytes_in);
+    bump(stats.m_bytes_out, bytes_out);
+    stats.m_latency.record(latency_ns / 1000);
+  }
+};
+
+struct metrics {
+public:
+  // id the router gave to the route that answered 'req', 0 when none did
+  static unsigned route_of(const request &req) { return req.m_route; }
+
+  // Prometheus text exposition format (0.0.4) of the counters of every worker summed, the route
+  // names are indexed by route id minus one
+  static std::string render(const std::vector<std::string> &route_names, const std::vector<const worker_stats *> &);
+  // handler answering with what 'render' returns
+  static path_handler handler(const std::vector<std::string> *route_names, const std::vector<const worker_stats *> *);
+};
+
+} // namespace fc
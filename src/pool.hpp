@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace fc {
+
+// Freelist of fixed-size read buffers owned by one worker, so only its loop thread touches it.
+// Buffers of any other size (a request head larger than one slab) bypass the freelist.
+struct buffer_pool {
+public:
+  size_t m_slab_size;
+  size_t m_max_free;
+  std::vector<char *> m_free;
+
+  // written by the owning loop only, read by whoever reports them
+  std::atomic<uint64_t> m_hits;
+  std::atomic<uint64_t> m_misses;
+
+  buffer_pool(size_t slab_size, size_t max_free) : m_slab_size(slab_size), m_max_free(max_free), m_free(), m_hits(0), m_misses(0) {}
+  ~buffer_pool() {
+    for (char *buf : m_free) delete[] buf;
+  }
+
+  char *acquire(size_t size) {
+    if (size == m_slab_size && !m_free.empty()) {
+      char *buf = m_free.back();
+      m_free.pop_back();
+      m_hits.store(m_hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return buf;
+    }
+    m_misses.store(m_misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return new char[size];
+  }
+
+  void release(char *buf, size_t size) {
+    if (!buf) return;
+    if (size == m_slab_size && m_free.size() < m_max_free) {
+      m_free.push_back(buf);
+      return;
+    }
+    delete[] buf;
+  }
+};
+
+} // namespace fc
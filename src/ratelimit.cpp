@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <uv.h>
+
+#include "conn.hpp"
+#include "include/fc.hpp"
+#include "ratelimit.hpp"
+
+namespace fc {
+
+rate_limit::table::table(double rate, double burst, size_t capacity) : m_rate(rate), m_burst(std::max(burst, 1.0)), m_shard_capacity(std::max<size_t>(1, (capacity + FC_RATE_LIMIT_SHARDS - 1) / FC_RATE_LIMIT_SHARDS)), m_shards(new shard[FC_RATE_LIMIT_SHARDS]) {
+  for (size_t i = 0; i < FC_RATE_LIMIT_SHARDS; i++) {
+    m_shards[i].m_buckets.reserve(m_shard_capacity);
+    m_shards[i].m_slots.assign(std::bit_ceil(m_shard_capacity), NIL);
+  }
+}
+
+bool rate_limit::table::take(size_t key, uint64_t now) {
+  // the low bits pick the slot, the high ones the shard
+  shard &s = m_shards[(key >> (sizeof(size_t) * 8 - 16)) & (FC_RATE_LIMIT_SHARDS - 1)];
+  std::lock_guard<std::mutex> lock(s.m_mutex);
+  uint32_t *slot = &s.m_slots[key & (s.m_slots.size() - 1)];
+  uint32_t i = *slot;
+  while (i != NIL && s.m_buckets[i].m_key != key) i = s.m_buckets[i].m_chain;
+  if (i == NIL) {
+    i = s.claim(m_shard_capacity);
+    bucket &b = s.m_buckets[i];
+    b.m_key = key;
+    b.m_tokens = m_burst;
+    b.m_refilled = now;
+    b.m_chain = *slot;
+    *slot = i;
+  } else {
+    bucket &b = s.m_buckets[i];
+    if (now > b.m_refilled) b.m_tokens = std::min(m_burst, b.m_tokens + (now - b.m_refilled) * m_rate / 1e9);
+    b.m_refilled = now;
+    s.unlink(i);
+  }
+  s.push_newest(i);
+  bucket &b = s.m_buckets[i];
+  if (b.m_tokens < 1) return false;
+  b.m_tokens -= 1;
+  return true;
+}
+
+uint32_t rate_limit::table::shard::claim(size_t capacity) {
+  if (m_buckets.size() < capacity) {
+    m_buckets.push_back({});
+    return m_buckets.size() - 1;
+  }
+  uint32_t i = m_oldest;
+  unlink(i);
+  // out of the chain of its slot as well
+  uint32_t *link = &m_slots[m_buckets[i].m_key & (m_slots.size() - 1)];
+  while (*link != i) link = &m_buckets[*link].m_chain;
+  *link = m_buckets[i].m_chain;
+  return i;
+}
+
+void rate_limit::table::shard::unlink(uint32_t i) {
+  bucket &b = m_buckets[i];
+  if (b.m_newer != NIL) m_buckets[b.m_newer].m_older = b.m_older;
+  else m_newest = b.m_older;
+  if (b.m_older != NIL) m_buckets[b.m_older].m_newer = b.m_newer;
+  else m_oldest = b.m_newer;
+}
+
+void rate_limit::table::shard::push_newest(uint32_t i) {
+  bucket &b = m_buckets[i];
+  b.m_newer = NIL;
+  b.m_older = m_newest;
+  if (m_newest != NIL) m_buckets[m_newest].m_newer = i;
+  m_newest = i;
+  if (m_oldest == NIL) m_oldest = i;
+}
+
+rate_limit::rate_limit(double rate, double burst, std::string key_header, unsigned trusted_hops, size_t capacity)
+    : m_table(std::make_shared<table>(rate, burst, capacity)), m_key_header(std::move(key_header)), m_trusted_hops(std::max(trusted_hops, 1u)) {}
+
+// entry 'hops' from the end of a comma separated list, empty when the list is shorter
+static std::string_view from_the_end(std::string_view list, unsigned hops) {
+  for (unsigned i = 1; i < hops; i++) {
+    size_t comma = list.rfind(',');
+    if (comma == std::string_view::npos) return {};
+    list = list.substr(0, comma);
+  }
+  size_t comma = list.rfind(',');
+  std::string_view entry = comma == std::string_view::npos ? list : list.substr(comma + 1);
+  while (!entry.empty() && (entry.front() == ' ' || entry.front() == '\t')) entry.remove_prefix(1);
+  while (!entry.empty() && (entry.back() == ' ' || entry.back() == '\t')) entry.remove_suffix(1);
+  return entry;
+}
+
+// hash of the peer address without the port, several connections of a client share a bucket
+static size_t peer_hash(const request &req) {
+  connection *conn = (connection *)req.get_remote();
+  // a request not read from a socket, there is only one such client
+  if (!conn) return 1;
+  if (conn->m_peer_hash) return conn->m_peer_hash;
+  struct sockaddr_storage addr;
+  int len = sizeof(addr);
+  std::string_view bytes;
+  if (0 == uv_tcp_getpeername(&conn->m_handle, (struct sockaddr *)&addr, &len)) {
+    if (AF_INET == addr.ss_family) {
+      const auto *in = (const struct sockaddr_in *)&addr;
+      bytes = std::string_view((const char *)&in->sin_addr, sizeof(in->sin_addr));
+    } else if (AF_INET6 == addr.ss_family) {
+      const auto *in6 = (const struct sockaddr_in6 *)&addr;
+      bytes = std::string_view((const char *)&in6->sin6_addr, sizeof(in6->sin6_addr));
+    }
+  }
+  // 0 marks a hash not computed yet
+  conn->m_peer_hash = std::max<size_t>(std::hash<std::string_view>{}(bytes), 1);
+  return conn->m_peer_hash;
+}
+
+response rate_limit::operator()(request &req) const {
+  size_t key = 0;
+  if (!m_key_header.empty()) {
+    if (auto value = req.get_header(m_key_header)) {
+      // a proxy appends the address it got the request from, the leading entries are whatever the
+      // client sent and would give it a fresh bucket each time
+      std::string_view client = from_the_end(*value, m_trusted_hops);
+      if (!client.empty()) key = std::max<size_t>(std::hash<std::string_view>{}(client), 1);
+    }
+  }
+  if (!key) key = peer_hash(req);
+  if (!m_table->take(key, uv_hrtime())) return response::canned(status::TOO_MANY_REQUESTS);
+  return req.next();
+}
+
+} // namespace fc
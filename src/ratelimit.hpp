@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "include/fc.hpp"
+
+#define FC_RATE_LIMIT_SHARDS (64) // a power of two, workers only contend when hitting the same one
+
+namespace fc {
+
+// Token buckets of the clients seen lately, keyed by a hash of what tells them apart. Each shard
+// is a fixed-size hash table (chained through indices, never reallocated once full) with its
+// buckets linked in least recently used order, the oldest one being reused for a new client.
+struct rate_limit::table {
+public:
+  static constexpr uint32_t NIL = UINT32_MAX;
+
+  struct bucket {
+    size_t m_key;
+    double m_tokens;
+    uint64_t m_refilled; // ns
+    uint32_t m_chain;    // next bucket in the same slot
+    uint32_t m_newer;    // neighbours in the recency list
+    uint32_t m_older;
+  };
+
+  struct alignas(64) shard {
+  public:
+    std::mutex m_mutex;
+    std::vector<bucket> m_buckets;
+    std::vector<uint32_t> m_slots; // heads of the chains, a power of two of them
+    uint32_t m_newest = NIL;
+    uint32_t m_oldest = NIL;
+
+    // index of a bucket for a client not in the table, the oldest one's when full
+    uint32_t claim(size_t capacity);
+    void unlink(uint32_t);
+    void push_newest(uint32_t);
+  };
+
+  double m_rate;  // tokens per second
+  double m_burst; // tokens at most
+  size_t m_shard_capacity;
+  std::unique_ptr<shard[]> m_shards;
+
+  table(double rate, double burst, size_t capacity);
+
+  // takes a token from the bucket of 'key' refilled up to 'now' (ns), false when there is none
+  bool take(size_t key, uint64_t now);
+};
+
+} // namespace fc
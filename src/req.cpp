@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <optional>
 #include <stdexcept>
 #include <string>
@@ -12,50 +13,114 @@
 
 namespace fc {
 
-request request_factory(void *remote, std::string_view raw) { return request(remote, raw); }
+request request_factory(void *remote, std::string_view raw, std::pmr::memory_resource *arena) {
+  return request(remote, raw, arena ? arena : std::pmr::get_default_resource());
+}
 
 response request::next() {
-  if (m_handlers.size() <= 0) {
+  if (!m_handlers || m_next_handler == 0) {
     throw std::runtime_error("No next function");
   }
-  auto next = m_handlers.back();
-  m_handlers.pop_back();
-  return next(*this);
+  return (*m_handlers)[--m_next_handler](*this);
+}
+
+// copies keep allocating from the arena of the request they were copied from, the header index
+// and cookies are shared since they live in that same arena. A joined body is owned by each
+// request, its view is pointed at the new buffer.
+request::request(const request &other)
+    : m_uvremote(other.m_uvremote), m_arena(other.m_arena), m_method(other.m_method), m_raw(other.m_raw), m_path(other.m_path), m_raw_body(other.m_raw_body), m_body_buf(other.m_body_buf), m_params(other.m_params, other.m_arena), m_headers(other.m_headers, other.m_arena), m_header_index(other.m_header_index), m_cookies(other.m_cookies), m_json(other.m_json), m_max_json_size(other.m_max_json_size), m_max_json_depth(other.m_max_json_depth), m_keep_alive(other.m_keep_alive), m_http_minor(other.m_http_minor), m_handlers(other.m_handlers), m_next_handler(other.m_next_handler), m_route(other.m_route) {
+  if (!m_body_buf.empty()) m_raw_body = std::string_view(m_body_buf.data(), m_body_buf.size());
 }
 
-request::~request() {
-  if (m_cookies) delete m_cookies;
+request::request(request &&other) noexcept
+    : m_uvremote(other.m_uvremote), m_arena(other.m_arena), m_method(other.m_method), m_raw(other.m_raw), m_path(other.m_path), m_raw_body(other.m_raw_body), m_body_buf(std::move(other.m_body_buf)), m_params(std::move(other.m_params)), m_headers(std::move(other.m_headers)), m_header_index(other.m_header_index), m_cookies(other.m_cookies), m_json(std::move(other.m_json)), m_max_json_size(other.m_max_json_size), m_max_json_depth(other.m_max_json_depth), m_keep_alive(other.m_keep_alive), m_http_minor(other.m_http_minor), m_handlers(other.m_handlers), m_next_handler(other.m_next_handler), m_route(other.m_route) {
+  if (!m_body_buf.empty()) m_raw_body = std::string_view(m_body_buf.data(), m_body_buf.size());
 }
 
+request::~request() = default;
+
 std::optional<std::string> request::get_param(const std::string &key) const {
-  if (auto it = std::find_if(m_params.begin(), m_params.end(), [key](const std::pair<std::string_view, std::string> &p) { return p.first == key; }); it != m_params.end())
-    return it->second;
+  if (auto it = std::find_if(m_params.begin(), m_params.end(), [&key](const auto &p) { return p.first == key; }); it != m_params.end())
+    return std::string(it->second);
+  return std::nullopt;
+}
+
+void request::index_header(size_t pos) {
+  if (!m_header_index) {
+    m_header_index = std::pmr::polymorphic_allocator<>(m_arena).new_object<header_index>();
+  }
+  m_header_index->insert(m_headers, pos);
+}
+
+std::optional<std::string_view> request::get_header(std::string_view key) const {
+  if (!m_header_index) return std::nullopt;
+  if (auto pos = m_header_index->find(m_headers, key)) return m_headers[*pos].second;
   return std::nullopt;
 }
 
-std::optional<std::string_view> request::get_header(const std::string &key) const {
-  if (auto it = std::find_if(m_headers.begin(), m_headers.end(), [key](const std::pair<std::string_view, std::string_view> &p) { return p.first == key; }); it != m_headers.end())
-    return it->second;
+std::optional<std::string_view> request::get_header(header h) const {
+  if (!m_header_index) return std::nullopt;
+  if (uint16_t slot = m_header_index->m_known[static_cast<size_t>(h)]) return m_headers[slot - 1].second;
+  if (m_header_index->m_overflow) return get_header(header_index::KNOWN_NAMES[static_cast<size_t>(h)]);
   return std::nullopt;
 }
 
-std::optional<std::string_view> request::get_cookie(const std::string &name) {
-  static auto cookies_header = get_header("Cookie");
-  if (!cookies_header.has_value()) {
-    return std::nullopt;
+void request::header_index::insert(const header_list &headers, size_t pos) {
+  if (pos >= UINT16_MAX) {
+    m_overflow = true;
+    return;
+  }
+  std::string_view name = headers[pos].first;
+  uint32_t hash = header_hash(name);
+  for (size_t k = 0; k < KNOWN_HASHES.size(); k++) {
+    if (KNOWN_HASHES[k] == hash && !m_known[k] && iequals(KNOWN_NAMES[k], name)) {
+      m_known[k] = pos + 1;
+      break;
+    }
+  }
+  if (m_size >= NSLOTS * 3 / 4) {
+    m_overflow = true;
+    return;
   }
+  for (size_t i = hash & (NSLOTS - 1);; i = (i + 1) & (NSLOTS - 1)) {
+    if (!m_slots[i]) {
+      m_hashes[i] = hash;
+      m_slots[i] = pos + 1;
+      m_size++;
+      return;
+    }
+    // a repeated name keeps its first value
+    if (m_hashes[i] == hash && iequals(headers[m_slots[i] - 1].first, name)) return;
+  }
+}
+
+std::optional<size_t> request::header_index::find(const header_list &headers, std::string_view name) const {
+  uint32_t hash = header_hash(name);
+  for (size_t i = hash & (NSLOTS - 1); m_slots[i]; i = (i + 1) & (NSLOTS - 1)) {
+    if (m_hashes[i] == hash && iequals(headers[m_slots[i] - 1].first, name)) return m_slots[i] - 1;
+  }
+  if (m_overflow) {
+    for (size_t pos = 0; pos < headers.size(); pos++) {
+      if (iequals(headers[pos].first, name)) return pos;
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<std::string_view> request::get_cookie(const std::string &name) {
   if (!m_cookies) {
-    m_cookies = new cookies();
+    auto cookies_header = get_header(header::COOKIE);
+    if (!cookies_header.has_value()) {
+      return std::nullopt;
+    }
+    // lives in the arena with the rest of the request, nothing to free
+    m_cookies = std::pmr::polymorphic_allocator<>(m_arena).new_object<cookies>(m_arena);
     m_cookies->parsed = true;
     m_cookies->parse(cookies_header.value());
   }
   return m_cookies->get(name);
 }
 
-nlohmann::json request::json() {
-  return nlohmann::json::parse(m_raw_body);
-}
-
 inline std::string_view trim(std::string_view str) {
   while (!str.empty() && std::isspace(static_cast<unsigned char>(str.front())))
     str.remove_prefix(1);
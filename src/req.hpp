@@ -1,19 +1,73 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
 #include <string_view>
 #include <utility>
+#include <vector>
 
 #include "include/fc.hpp"
 
 namespace fc {
 
+using header_list = std::pmr::vector<std::pair<std::string_view, std::string_view>>;
+
+constexpr char ascii_lower(char c) { return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c; }
+
+// FNV-1a of the lowercased name
+constexpr uint32_t header_hash(std::string_view name) {
+  uint32_t hash = 2166136261u;
+  for (char c : name) hash = (hash ^ static_cast<unsigned char>(ascii_lower(c))) * 16777619u;
+  return hash;
+}
+
+constexpr bool iequals(std::string_view a, std::string_view b) {
+  if (a.length() != b.length()) return false;
+  for (size_t i = 0; i < a.length(); i++) {
+    if (ascii_lower(a[i]) != ascii_lower(b[i])) return false;
+  }
+  return true;
+}
+
+// Open addressing table (linear probing) over the headers of a request, keyed by the hash of the
+// lowercased name and holding positions in 'm_headers' so the views can be rebased freely. Names
+// in 'fc::header' also get a slot of their own. Past 3/4 of the table, names are no longer indexed
+// and lookups missing it scan the headers instead.
+struct request::header_index {
+  static constexpr size_t NSLOTS = 64; // power of two
+  // same order as 'fc::header'
+  static constexpr std::array<std::string_view, static_cast<size_t>(header::COUNT)> KNOWN_NAMES = {
+      "host", "content-length", "content-type", "authorization", "cookie", "connection", "accept-encoding"};
+  static constexpr std::array<uint32_t, KNOWN_NAMES.size()> KNOWN_HASHES = [] {
+    std::array<uint32_t, KNOWN_NAMES.size()> hashes{};
+    for (size_t i = 0; i < KNOWN_NAMES.size(); i++) hashes[i] = header_hash(KNOWN_NAMES[i]);
+    return hashes;
+  }();
+
+  // 1 + position in the headers, 0 for none
+  std::array<uint16_t, KNOWN_NAMES.size()> m_known{};
+  std::array<uint16_t, NSLOTS> m_slots{};
+  std::array<uint32_t, NSLOTS> m_hashes{};
+  size_t m_size = 0;
+  bool m_overflow = false;
+
+  void insert(const header_list &, size_t pos);
+  std::optional<size_t> find(const header_list &, std::string_view name) const;
+};
+
 struct request::cookies {
   bool parsed = false;
-  std::vector<std::pair<std::string_view, std::string_view>> m_cookies;
+  std::pmr::vector<std::pair<std::string_view, std::string_view>> m_cookies;
+
+  explicit cookies(std::pmr::memory_resource *arena) : m_cookies(arena) {}
   void parse(std::string_view header);
   std::optional<std::string_view> get(std::string_view key) const;
 };
 
-request request_factory(void *, std::string_view);
+// 'arena' backs the request state, the default resource is used when none is given
+request request_factory(void *, std::string_view, std::pmr::memory_resource *arena = nullptr);
 
 } // namespace fc
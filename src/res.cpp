@@ -1,7 +1,10 @@
-#include <cstring>
-#include <format>
+#include <charconv>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unistd.h>
 
+#include "canned.hpp"
 #include "http.hpp"
 #include "include/fc.hpp"
 #include "templates.hpp"
@@ -9,13 +12,27 @@
 namespace fc {
 
 const response response::ok(status stats) {
-  const char *stats_str = status_to_string(stats);
-  return response(std::move(std::format(templates::OK_RESPONSE, static_cast<int>(stats), stats_str, strlen(stats_str), stats_str)));
+  response res(stats, templates::CONTENT_TYPE_TEXT);
+  res.append_static_body(status_to_string(stats));
+  return res;
 }
 
-const response response::json(nlohmann::json j, status stats) {
-  auto xs = j.dump();
-  return response(std::move(std::format(templates::HTTP_RESPONSE_FORMAT, static_cast<int>(stats), status_to_string(stats), "application/json", xs.length(), std::move(xs))));
+const response response::json(const nlohmann::json &j, status stats) {
+  response res(stats, templates::CONTENT_TYPE_JSON);
+  res.append_body(j.dump());
+  return res;
+}
+
+const response response::canned(status status) {
+  response res(status, nullptr);
+  res.m_canned = true;
+  return res;
+}
+
+const response response::pending() {
+  response res(status::OK, nullptr);
+  res.m_pending = true;
+  return res;
 }
 
 void response::set_status(status status) {
@@ -24,6 +41,77 @@ void response::set_status(status status) {
 
 void response::set_content_type(const std::string content_type) {
   m_content_type = content_type;
+  m_content_type_line = nullptr;
+}
+
+void response::set_header(std::string_view name, std::string_view value) {
+  m_headers.append(name).append(": ").append(value).append("\r\n");
+}
+
+void response::append_body(std::string data) {
+  if (data.empty()) return;
+  // the string is moved into the owner, its bytes stay where they are
+  auto owner = std::make_shared<std::string>(std::move(data));
+  m_body.push_back({*owner, std::move(owner)});
+}
+
+void response::append_body(std::shared_ptr<const std::string> data) {
+  if (!data || data->empty()) return;
+  m_body.push_back({*data, std::move(data)});
+}
+
+void response::append_static_body(std::string_view data) {
+  if (data.empty()) return;
+  m_body.push_back({data, nullptr});
+}
+
+size_t response::content_length() const {
+  if (m_serialized) return m_serialized->size() - m_serialized_head;
+  size_t len = 0;
+  for (auto &seg : m_body) len += seg.m_data.size();
+  if (m_file) len += m_file->m_length;
+  return len;
+}
+
+void response::write_head(std::string &out, std::string_view extra) const {
+  out.append(status_line(m_status)).append(templates::SERVER);
+  if (m_content_type_line) {
+    out.append(m_content_type_line);
+  } else if (!m_content_type.empty()) {
+    out.append("Content-Type: ").append(m_content_type).append("\r\n");
+  }
+  // these never carry a body, a 304 would otherwise advertise the wrong length, the length of a
+  // streamed body is not known up front
+  int code = static_cast<int>(m_status);
+  if (!m_stream && code >= 200 && m_status != status::NO_CONTENT && m_status != status::NOT_MODIFIED) {
+    char len[24];
+    auto [end, _] = std::to_chars(len, len + sizeof(len), content_length());
+    out.append("Content-Length: ").append(len, end).append("\r\n");
+  }
+  out.append(m_headers).append(extra).append("\r\n");
+}
+
+std::string response::to_string() const {
+  if (m_canned) {
+    std::string_view message = canned_response(m_status, conn_header::NONE);
+    if (!message.empty()) return std::string(message);
+    return ok(m_status).to_string();
+  }
+  if (m_serialized) {
+    std::string raw(*m_serialized);
+    raw.insert(m_serialized_head, templates::CRLF);
+    return raw;
+  }
+  std::string raw;
+  write_head(raw);
+  for (auto &seg : m_body) raw.append(seg.m_data);
+  if (m_file) {
+    size_t at = raw.size();
+    raw.resize(at + m_file->m_length);
+    ssize_t n = pread(m_file->m_fd, raw.data() + at, m_file->m_length, m_file->m_offset);
+    raw.resize(at + (n > 0 ? n : 0));
+  }
+  return raw;
 }
 
 } // namespace fc
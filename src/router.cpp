@@ -1,7 +1,9 @@
 #include <cstring>
 #include <stdexcept>
+#include <string_view>
 #include <vector>
 
+#include "http.hpp"
 #include "include/fc.hpp"
 #include "router.hpp"
 
@@ -27,71 +29,115 @@ void router::patch(const std::string path, path_handler handler) {
   m_routes.push_back(route(method::PATCH, path, handler));
 }
 
-// TODO: normalize in place to avoid std::string allocation
-std::string root_router::normalize_path(const std::string_view &input) {
-  bool prevSlash = false;
-  std::string output;
-  output.reserve(input.length());
-  for (auto chr : input) {
-    if (('/' == chr && prevSlash) || std::isspace(chr)) {
-      continue;
-    }
-    prevSlash = (chr == '/');
-    output.push_back(chr);
+// Returns the node ending right after 's', splitting the child sharing only part of it
+radix_node *radix_node::insert_static(std::string_view s) {
+  if (s.empty()) return this;
+  const void *at = std::memchr(m_indices.data(), s.front(), m_indices.size());
+  if (!at) {
+    radix_node *child = new radix_node(std::string(s));
+    m_indices.push_back(s.front());
+    m_children.push_back(child);
+    return child;
+  }
+  size_t i = (const char *)at - m_indices.data();
+  radix_node *child = m_children[i];
+  size_t common = 0;
+  while (common < s.size() && common < child->m_prefix.size() && s[common] == child->m_prefix[common]) common++;
+  if (common < child->m_prefix.size()) {
+    radix_node *mid = new radix_node(child->m_prefix.substr(0, common));
+    child->m_prefix.erase(0, common);
+    mid->m_indices.push_back(child->m_prefix.front());
+    mid->m_children.push_back(child);
+    m_children[i] = child = mid;
+  }
+  return child->insert_static(s.substr(common));
+}
+
+radix_node *radix_node::insert_param(std::string_view name) {
+  if (!m_param) {
+    m_param = new radix_node();
+    m_param->m_label = name;
+  } else if (m_param->m_label != name) {
+    throw std::runtime_error("Conflicting dynamic segment names: " + m_param->m_label + " vs " + std::string(name));
   }
-  return output;
+  return m_param;
+}
+
+radix_node *radix_node::insert_wildcard() {
+  if (!m_wildcard) m_wildcard = new radix_node();
+  return m_wildcard;
 }
 
-// TODO: return vec of string_views to avoid std::string alloc.
-std::vector<std::string> root_router::split_path(const std::string_view &path) {
-  std::vector<std::string> frags;
-  auto normalPath = normalize_path(path);
-  char *frag = std::strtok((char *)normalPath.c_str(), "/");
-  while (frag) {
-    frags.push_back(frag);
-    frag = std::strtok(nullptr, "/");
+// 'path' is what is left once this node's prefix was matched. Static children are tried first,
+// then the dynamic one and the wildcard last, backtracking when a branch dead-ends further down.
+const radix_node *radix_node::find(std::string_view path, route_params &params) const {
+  if (path.empty()) return m_handlers ? this : nullptr;
+  if (const radix_node *child = static_child(path.front()); child && path.starts_with(child->m_prefix)) {
+    if (const radix_node *found = child->find(path.substr(child->m_prefix.size()), params)) return found;
+  }
+  if (m_param) {
+    std::string_view segment = path.substr(0, path.find('/'));
+    params.emplace_back(m_param->m_label, segment);
+    if (const radix_node *found = m_param->find(path.substr(segment.size()), params)) return found;
+    params.pop_back();
   }
-  return frags;
+  // swallows the rest of the path
+  if (m_wildcard && m_wildcard->m_handlers) return m_wildcard;
+  return nullptr;
+}
+
+radix_node::~radix_node() {
+  for (radix_node *child : m_children) delete child;
+  delete m_param;
+  delete m_wildcard;
+  delete m_handlers;
+}
+
+std::string_view root_router::canonical_path(std::string_view path, std::pmr::memory_resource *mr) {
+  path = path.substr(0, path.find_first_of("?#"));
+  if (path.starts_with('/') && path.find("//") == std::string_view::npos && (path.size() == 1 || path.back() != '/')) return path;
+
+  char *buf = (char *)mr->allocate(path.size() + 1, 1);
+  size_t len = 0;
+  std::string_view segment;
+  while (next_segment(path, segment)) {
+    buf[len++] = '/';
+    std::memcpy(buf + len, segment.data(), segment.size());
+    len += segment.size();
+  }
+  if (len == 0) buf[len++] = '/';
+  return {buf, len};
 }
 
 void root_router::add(method method, const std::string path, path_handler handler, const std::vector<path_handler> &midwares) {
-  auto path_fragments = split_path(path);
-  frag *current = &m_root;
+  radix_node *current = &m_root;
+  // static bytes not inserted yet, they are flushed in one go before a dynamic segment
+  std::string pending;
+  std::string_view rest = path, frg;
 
-  for (const auto &frg : path_fragments) {
-    frag_type type;
+  while (next_segment(rest, frg)) {
+    pending.push_back('/');
     switch (frg.at(0)) {
-    case ':': type = frag_type::DYNAMIC; break;
-    case '*': type = frag_type::WILDCARD; break;
-    default: type = frag_type::STATIC; break;
-    }
-
-    bool found = false;
-    frag *prev = nullptr;
-    frag *child = current->m_child;
-    while (child) {
-      if ((type == frag_type::STATIC && child->m_label == frg) || (type != frag_type::STATIC && child->m_type == type)) {
-        if (type == frag_type::DYNAMIC && child->m_label != frg && (child->m_handlers && !child->m_handlers->at((int)method).empty())) {
-          throw std::runtime_error("Conflicting dynamic segment names: " + child->m_label + " vs " + frg);
-        }
-        found = true;
-        break;
-      }
-      prev = child;
-      child = child->m_next;
-    }
-    if (!found) {
-      frag *newFrag = new frag(type, frag_type::DYNAMIC == type ? frg.substr(1) : frg);
-      if (prev) {
-        prev->m_next = newFrag;
-      } else {
-        current->m_child = newFrag;
+    case ':':
+      current = current->insert_static(pending)->insert_param(frg.substr(1));
+      pending.clear();
+      break;
+    case '*':
+      if (next_segment(rest, frg)) {
+        throw std::runtime_error("Wildcard must be the last segment of path: " + path);
       }
-      child = newFrag;
+      current = current->insert_static(pending)->insert_wildcard();
+      pending.clear();
+      break;
+    default:
+      pending.append(frg);
+      break;
     }
-    current = child;
   }
-  // at this point we know that the current fragment is a leaf node
+  if (current == &m_root && pending.empty()) pending = "/";
+  current = current->insert_static(pending);
+
+  // at this point we know that the current node is a leaf node
   if (!current->m_handlers) {
     current->m_handlers = new frag_handlers_t();
   }
@@ -100,40 +146,45 @@ void root_router::add(method method, const std::string path, path_handler handle
   }
   current->m_handlers->at(static_cast<int>(method)).insert(current->m_handlers->at(static_cast<int>(method)).begin(), handler);
   current->m_handlers->at(static_cast<int>(method)).insert(current->m_handlers->at(static_cast<int>(method)).end(), midwares.begin(), midwares.end());
+  m_route_names.push_back(std::string(method_to_string(method)) + " " + path);
+  current->m_route_ids[static_cast<int>(method)] = m_route_names.size();
 }
 
-bool root_router::match(request &req) const {
-  auto fragments = split_path(req.m_path);
-  const frag *current = &m_root;
-  for (auto &frg : fragments) {
-    bool found = false;
-    const frag *child = current->m_child;
-    while (child && !found) {
-      switch (child->m_type) {
-      case frag_type::STATIC: found = frg == child->m_label; break;
-      case frag_type::DYNAMIC:
-        found = true;
-        req.m_params.push_back({child->m_label, frg});
-        break;
-      case frag_type::WILDCARD:
-        // TODOOO: fill handler & midware
-        return true;
-      }
-      if (found) {
-        current = child;
-        break;
-      }
-      child = child->m_next;
-    }
-    if (!found) {
-      return false;
+void root_router::add_static(static_dispatch dispatch, const std::vector<std::pair<method, std::string_view>> &routes) {
+  m_static.push_back(dispatch);
+  m_static_ids.push_back(m_route_names.size());
+  for (auto &[method, path] : routes) m_route_names.push_back(std::string(method_to_string(method)) + " " + std::string(path));
+}
+
+bool root_router::dispatch_static(request &req, std::optional<response> &res) const {
+  for (size_t i = 0; i < m_static.size(); i++) {
+    if (m_static[i](req, res)) {
+      req.m_route += m_static_ids[i] + 1;
+      return true;
     }
   }
-  auto handler = current->m_handlers->at(static_cast<int>(req.m_method));
-  if (handler.empty()) {
+  return false;
+}
+
+bool root_router::match(request &req, unsigned *allowed) const {
+  const radix_node *found = m_root.find(canonical_path(req.m_path, req.m_arena), req.m_params);
+  if (!found) {
+    return false;
+  }
+  const auto &handlers = found->m_handlers->at(static_cast<int>(req.m_method));
+  if (handlers.empty()) {
+    if (allowed) {
+      *allowed = 0;
+      for (size_t m = 0; m < found->m_handlers->size(); m++) {
+        if (!(*found->m_handlers)[m].empty()) *allowed |= 1u << m;
+      }
+    }
     return false;
   }
-  req.m_handlers.insert(req.m_handlers.begin(), handler.begin(), handler.end());
+  // the chain is shared by every request on this route, the request only keeps a cursor into it
+  req.m_handlers = &handlers;
+  req.m_next_handler = handlers.size();
+  req.m_route = found->m_route_ids[static_cast<int>(req.m_method)];
   return true;
 }
 
@@ -1,44 +1,83 @@
 #pragma once
 
+#include <array>
+#include <cstring>
+#include <memory_resource>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 #include "include/fc.hpp"
 
 namespace fc {
 
-enum class frag_type {
-  STATIC = 1,
-  DYNAMIC = 2,
-  WILDCARD = 3,
-};
-
 using frag_handlers_t = std::array<std::vector<path_handler>, static_cast<int>(method::COUNT)>;
+// (name, value) of every dynamic segment met on the way, values are views into the matched path
+using route_params = std::pmr::vector<std::pair<std::string_view, std::string_view>>;
 
-struct frag {
+// Node of the compressed radix tree holding the routes. A static node matches the bytes of its
+// prefix, which may span several segments ("/api/v1/users/") or end in the middle of one when two
+// routes part ways there. Static children are looked up by their first byte, which is unique among
+// siblings. Dynamic (':name') and wildcard ('*') children hang off nodes whose prefix ends with a
+// '/', so they always start on a segment boundary.
+struct radix_node {
 public:
-  frag_type m_type;
-  std::string m_label;
+  std::string m_prefix;  // static bytes, empty on dynamic and wildcard nodes
+  std::string m_label;   // name of a dynamic segment
+  std::string m_indices; // first byte of every static child, same order as 'm_children'
+  std::vector<radix_node *> m_children;
+  radix_node *m_param;
+  radix_node *m_wildcard;
   frag_handlers_t *m_handlers;
+  // id of the route registered for each method, see 'root_router::m_route_names'
+  std::array<unsigned, static_cast<int>(method::COUNT)> m_route_ids;
+
+  radix_node(std::string prefix = "") : m_prefix(std::move(prefix)), m_param(nullptr), m_wildcard(nullptr), m_handlers(nullptr), m_route_ids() {}
+  radix_node(const radix_node &) = delete;
+  ~radix_node();
 
-  frag *m_next;
-  frag *m_child;
+  radix_node *static_child(char c) const {
+    const void *at = std::memchr(m_indices.data(), c, m_indices.size());
+    return at ? m_children[(const char *)at - m_indices.data()] : nullptr;
+  }
 
-  frag() = default;
-  frag(frag_type type, std::string label) : m_type(type), m_label(label), m_handlers(nullptr), m_next(nullptr), m_child(nullptr) {};
+  radix_node *insert_static(std::string_view);
+  radix_node *insert_param(std::string_view name);
+  radix_node *insert_wildcard();
+  // node holding the handlers of the path, null when no route matches it
+  const radix_node *find(std::string_view, route_params &) const;
 };
 
 struct root_router {
 public:
-  frag m_root;
+  radix_node m_root;
+  // tables declared with 'fc::routes', tried in order before the tree
+  std::vector<static_dispatch> m_static;
+  // "<METHOD> <path>" of every route, a route id is its position in here plus one, 0 meaning none
+  std::vector<std::string> m_route_names;
+  // id of the first route of each table in 'm_static', minus one
+  std::vector<unsigned> m_static_ids;
 
   root_router() = default;
 
   void add(method method, const std::string, path_handler, const std::vector<path_handler> &);
-  bool match(request &) const;
+  void add_static(static_dispatch, const std::vector<std::pair<method, std::string_view>> &routes);
+  // When the path has routes but none for the method of the request, they are left in 'allowed'
+  // as one bit per method
+  bool match(request &, unsigned *allowed = nullptr) const;
+  bool dispatch_static(request &, std::optional<response> &) const;
+  // Handlers of every method registered for 'path', which must be canonical. Values of the dynamic
+  // segments are appended to 'params'.
+  const frag_handlers_t *find(std::string_view path, route_params &params) const {
+    const radix_node *node = m_root.find(path, params);
+    return node ? node->m_handlers : nullptr;
+  }
 
-  static std::string normalize_path(const std::string_view &);
-  static std::vector<std::string> split_path(const std::string_view &);
+  // Path without its query string, repeated and trailing slashes. Returned as is when already
+  // canonical, otherwise rebuilt in memory taken from 'mr' and never handed back (an arena).
+  static std::string_view canonical_path(std::string_view path, std::pmr::memory_resource *mr);
 };
 
 } // namespace fc
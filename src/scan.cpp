@@ -0,0 +1,78 @@
+#include "scan.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace fc::scan {
+
+static inline bool printable(unsigned char c, unsigned char lo) { return c >= lo && c < 0x7f; }
+
+const char *scalar(const char *p, const char *end, unsigned char lo) {
+  while (p < end && printable(*p, lo)) p++;
+  return p;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// may run from a static initializer, before libgcc filled the cpu model
+bool has_sse42() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2");
+}
+
+bool has_avx2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+// the ranges to look for are [0, lo - 1] and [0x7f, 0xff], as picohttpparser does
+__attribute__((target("sse4.2"))) const char *sse42(const char *p, const char *end, unsigned char lo) {
+  const __m128i ranges = _mm_setr_epi8(0, lo - 1, 0x7f, (char)0xff, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  while (end - p >= 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i *)p);
+    int i = _mm_cmpestri(ranges, 4, bytes, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+    if (i != 16) return p + i;
+    p += 16;
+  }
+  return scalar(p, end, lo);
+}
+
+// printable bytes are the ones in (lo - 1, 0x7f) compared as signed, non ascii bytes are negative
+__attribute__((target("avx2"))) const char *avx2(const char *p, const char *end, unsigned char lo) {
+  const __m256i above = _mm256_set1_epi8(lo - 1);
+  const __m256i below = _mm256_set1_epi8(0x7f);
+  while (end - p >= 32) {
+    __m256i bytes = _mm256_loadu_si256((const __m256i *)p);
+    __m256i ok = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, above), _mm256_cmpgt_epi8(below, bytes));
+    unsigned mask = ~(unsigned)_mm256_movemask_epi8(ok);
+    if (mask) return p + __builtin_ctz(mask);
+    p += 32;
+  }
+  // not 'sse42', its legacy encoded instructions would pay for the dirty upper halves
+  return scalar(p, end, lo);
+}
+
+static scan_fn select() {
+  if (has_avx2()) return avx2;
+  if (has_sse42()) return sse42;
+  return scalar;
+}
+
+#else
+
+static scan_fn select() { return scalar; }
+
+#endif
+
+const scan_fn find_unprintable = select();
+
+const char *name() {
+  if (find_unprintable == scalar) return "scalar";
+#if defined(__x86_64__) || defined(__i386__)
+  if (find_unprintable == sse42) return "sse4.2";
+#endif
+  return "avx2";
+}
+
+} // namespace fc::scan
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+namespace fc {
+
+// Returns the first byte of [p, end) outside [lo, 0x7e] (a control character, DEL or a non ascii
+// byte), 'end' when there is none. Request lines and header values are made of printable bytes
+// and end with a CR, so one call skips a whole field. 'lo' is 0x21 to stop on spaces as well.
+using scan_fn = const char *(*)(const char *p, const char *end, unsigned char lo);
+
+namespace scan {
+
+const char *scalar(const char *p, const char *end, unsigned char lo);
+#if defined(__x86_64__) || defined(__i386__)
+const char *sse42(const char *p, const char *end, unsigned char lo); // 16 bytes per step
+const char *avx2(const char *p, const char *end, unsigned char lo);  // 32 bytes per step
+bool has_sse42();
+bool has_avx2();
+#endif
+
+// widest implementation the CPU supports, checked once at startup
+extern const scan_fn find_unprintable;
+const char *name();
+
+} // namespace scan
+} // namespace fc
@@ -0,0 +1,360 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fcntl.h>
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "include/fc.hpp"
+#include "static.hpp"
+
+namespace fc {
+
+namespace {
+
+struct mime_type {
+  std::string_view m_ext;
+  const char *m_line;
+};
+
+constexpr mime_type MIME_TYPES[] = {
+    {".html", "Content-Type: text/html; charset=utf-8\r\n"},
+    {".htm", "Content-Type: text/html; charset=utf-8\r\n"},
+    {".css", "Content-Type: text/css; charset=utf-8\r\n"},
+    {".js", "Content-Type: text/javascript; charset=utf-8\r\n"},
+    {".mjs", "Content-Type: text/javascript; charset=utf-8\r\n"},
+    {".json", "Content-Type: application/json\r\n"},
+    {".map", "Content-Type: application/json\r\n"},
+    {".txt", "Content-Type: text/plain; charset=utf-8\r\n"},
+    {".xml", "Content-Type: application/xml\r\n"},
+    {".svg", "Content-Type: image/svg+xml\r\n"},
+    {".png", "Content-Type: image/png\r\n"},
+    {".jpg", "Content-Type: image/jpeg\r\n"},
+    {".jpeg", "Content-Type: image/jpeg\r\n"},
+    {".gif", "Content-Type: image/gif\r\n"},
+    {".webp", "Content-Type: image/webp\r\n"},
+    {".avif", "Content-Type: image/avif\r\n"},
+    {".ico", "Content-Type: image/x-icon\r\n"},
+    {".woff", "Content-Type: font/woff\r\n"},
+    {".woff2", "Content-Type: font/woff2\r\n"},
+    {".ttf", "Content-Type: font/ttf\r\n"},
+    {".wasm", "Content-Type: application/wasm\r\n"},
+    {".pdf", "Content-Type: application/pdf\r\n"},
+    {".mp3", "Content-Type: audio/mpeg\r\n"},
+    {".mp4", "Content-Type: video/mp4\r\n"},
+    {".webm", "Content-Type: video/webm\r\n"},
+};
+
+constexpr char DEFAULT_CONTENT_TYPE[] = "Content-Type: application/octet-stream\r\n";
+
+const char *content_type_line(const std::filesystem::path &path) {
+  std::string ext = path.extension().string();
+  for (char &c : ext) c = std::tolower((unsigned char)c);
+  for (auto &type : MIME_TYPES) {
+    if (type.m_ext == ext) return type.m_line;
+  }
+  return DEFAULT_CONTENT_TYPE;
+}
+
+// closes the file once the last response sending it is gone
+struct open_file {
+  int m_fd;
+
+  explicit open_file(int fd) : m_fd(fd) {}
+  open_file(const open_file &) = delete;
+  ~open_file() { ::close(m_fd); }
+};
+
+int64_t mtime_ns(const struct stat &st) { return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec; }
+
+std::string http_date(time_t t) {
+  char buf[32];
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  return std::string(buf, strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm));
+}
+
+std::optional<time_t> parse_http_date(std::string_view date) {
+  std::string str(date);
+  struct tm tm = {};
+  const char *end = strptime(str.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  if (!end || *end) return std::nullopt;
+  return timegm(&tm);
+}
+
+// changes whenever the file is rewritten, good enough to tell two versions apart
+std::string make_etag(const struct stat &st) {
+  char buf[48];
+  int n = snprintf(buf, sizeof(buf), "\"%llx-%llx\"", (unsigned long long)st.st_size, (unsigned long long)mtime_ns(st));
+  return std::string(buf, n);
+}
+
+std::shared_ptr<const std::string> read_file(const std::string &path, size_t size) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return nullptr;
+  auto data = std::make_shared<std::string>(size, '\0');
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = ::read(fd, data->data() + done, size - done);
+    if (n <= 0) break;
+    done += n;
+  }
+  ::close(fd);
+  // the file changed under us, it will be read again on the next request
+  if (done != size) return nullptr;
+  return data;
+}
+
+struct cached_file {
+  std::string m_path;
+  int64_t m_mtime_ns;
+  size_t m_size;
+  std::shared_ptr<const std::string> m_data;
+  std::string m_etag;
+  std::string m_last_modified;
+};
+
+// Small files read once and then served from memory, keyed by path and dropped as soon as the file
+// on disk changes. One cache per worker thread, so it never takes a lock, the least recently served
+// files making room for new ones.
+struct file_cache {
+  // files most recently served first, the map points into the list
+  std::list<cached_file> m_lru;
+  std::unordered_map<std::string_view, std::list<cached_file>::iterator> m_index;
+  size_t m_bytes = 0;
+
+  void erase(std::list<cached_file>::iterator it) {
+    m_bytes -= it->m_size;
+    m_index.erase(it->m_path);
+    m_lru.erase(it);
+  }
+
+  const cached_file *get(const std::string &path, const struct stat &st) {
+    auto found = m_index.find(path);
+    if (found != m_index.end()) {
+      auto it = found->second;
+      if (it->m_mtime_ns == mtime_ns(st) && it->m_size == (size_t)st.st_size) {
+        m_lru.splice(m_lru.begin(), m_lru, it);
+        return &*it;
+      }
+      erase(it);
+    }
+    auto data = read_file(path, st.st_size);
+    if (!data) return nullptr;
+    while (!m_lru.empty() && m_bytes + data->size() > FC_STATIC_CACHE_MAX_BYTES) erase(std::prev(m_lru.end()));
+    m_bytes += data->size();
+    m_lru.push_front({path, mtime_ns(st), data->size(), std::move(data), make_etag(st), http_date(st.st_mtime)});
+    // the map keys view the path owned by the list entry
+    m_index.emplace(m_lru.front().m_path, m_lru.begin());
+    return &m_lru.front();
+  }
+};
+
+thread_local file_cache cache;
+
+std::string_view trim(std::string_view str) {
+  while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) str.remove_prefix(1);
+  while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) str.remove_suffix(1);
+  return str;
+}
+
+// true when 'coding' is listed in an Accept-Encoding header without 'q=0'
+bool accepts(std::string_view header, std::string_view coding) {
+  while (!header.empty()) {
+    size_t comma = header.find(',');
+    std::string_view item = header.substr(0, comma);
+    header.remove_prefix(comma == std::string_view::npos ? header.size() : comma + 1);
+    size_t semicolon = item.find(';');
+    if (trim(item.substr(0, semicolon)) != coding) continue;
+    if (semicolon == std::string_view::npos) return true;
+    std::string_view param = trim(item.substr(semicolon + 1));
+    return !param.starts_with("q=") || std::strtod(std::string(param.substr(2)).c_str(), nullptr) > 0;
+  }
+  return false;
+}
+
+// If-None-Match lists entity tags compared weakly, "*" matches any
+bool etag_matches(std::string_view header, std::string_view etag) {
+  while (!header.empty()) {
+    size_t comma = header.find(',');
+    std::string_view tag = trim(header.substr(0, comma));
+    header.remove_prefix(comma == std::string_view::npos ? header.size() : comma + 1);
+    if (tag.starts_with("W/")) tag.remove_prefix(2);
+    if (tag == "*" || tag == etag) return true;
+  }
+  return false;
+}
+
+bool not_modified(const request &req, std::string_view etag, time_t mtime) {
+  // the entity tag wins when both are sent
+  if (auto none_match = req.get_header("If-None-Match")) return etag_matches(*none_match, etag);
+  if (auto since = req.get_header("If-Modified-Since")) {
+    auto date = parse_http_date(trim(*since));
+    return date && mtime <= *date;
+  }
+  return false;
+}
+
+bool parse_size(std::string_view str, size_t &out) {
+  if (str.empty()) return false;
+  out = 0;
+  for (char c : str) {
+    if (c < '0' || c > '9') return false;
+    out = out * 10 + (c - '0');
+  }
+  return true;
+}
+
+enum class range_result { NONE, OK, UNSATISFIABLE };
+
+// Single "bytes=first-last" range, open ended and suffix forms included. A malformed header or a
+// list of ranges is ignored and the whole file is sent, which is always allowed.
+range_result parse_range(std::string_view header, size_t size, size_t &first, size_t &len) {
+  header = trim(header);
+  if (!header.starts_with("bytes=")) return range_result::NONE;
+  std::string_view spec = trim(header.substr(6));
+  size_t dash = spec.find('-');
+  if (dash == std::string_view::npos || spec.find(',') != std::string_view::npos) return range_result::NONE;
+  std::string_view from = trim(spec.substr(0, dash)), to = trim(spec.substr(dash + 1));
+  size_t last = 0;
+  if (from.empty()) {
+    size_t suffix = 0;
+    if (!parse_size(to, suffix)) return range_result::NONE;
+    if (0 == suffix || 0 == size) return range_result::UNSATISFIABLE;
+    len = std::min(suffix, size);
+    first = size - len;
+    return range_result::OK;
+  }
+  if (!parse_size(from, first)) return range_result::NONE;
+  if (first >= size) return range_result::UNSATISFIABLE;
+  if (to.empty()) {
+    last = size - 1;
+  } else if (!parse_size(to, last) || last < first) {
+    return range_result::NONE;
+  }
+  len = std::min(last, size - 1) - first + 1;
+  return range_result::OK;
+}
+
+bool percent_decode(std::string_view in, std::string &out) {
+  out.clear();
+  for (size_t i = 0; i < in.size(); i++) {
+    if (in[i] != '%') {
+      out.push_back(in[i]);
+      continue;
+    }
+    if (i + 2 >= in.size() || !std::isxdigit((unsigned char)in[i + 1]) || !std::isxdigit((unsigned char)in[i + 2])) return false;
+    out.push_back((char)std::stoi(std::string(in.substr(i + 1, 2)), nullptr, 16));
+    i += 2;
+  }
+  return true;
+}
+
+} // namespace
+
+const response response::send(const std::filesystem::path path) {
+  return file(nullptr, path);
+}
+
+const response response::send(const request &req, const std::filesystem::path path) {
+  return file(&req, path);
+}
+
+response response::file(const request *req, const std::filesystem::path &path) {
+  std::string target = path.string();
+  struct stat st;
+  if (::stat(target.c_str(), &st) || !S_ISREG(st.st_mode)) return ok(status::NOT_FOUND);
+
+  response res(status::OK, content_type_line(path));
+  if (req) {
+    res.set_header("Vary", "Accept-Encoding");
+    // a precompressed sibling is sent in place of the file when the client takes it
+    if (auto accept = req->get_header("Accept-Encoding")) {
+      for (auto [ext, coding] : {std::pair{".br", "br"}, std::pair{".gz", "gzip"}}) {
+        struct stat sibling;
+        if (!accepts(*accept, coding) || ::stat((target + ext).c_str(), &sibling) || !S_ISREG(sibling.st_mode)) continue;
+        target += ext;
+        st = sibling;
+        res.set_header("Content-Encoding", coding);
+        break;
+      }
+    }
+  }
+
+  const cached_file *cached = st.st_size <= FC_STATIC_CACHE_MAX_FILE ? cache.get(target, st) : nullptr;
+  std::string etag = cached ? cached->m_etag : make_etag(st);
+  std::string last_modified = cached ? cached->m_last_modified : http_date(st.st_mtime);
+  res.set_header("ETag", etag);
+  res.set_header("Last-Modified", last_modified);
+  res.set_header("Accept-Ranges", "bytes");
+  if (req && not_modified(*req, etag, st.st_mtime)) {
+    res.m_status = status::NOT_MODIFIED;
+    return res;
+  }
+
+  size_t size = st.st_size, first = 0, len = size;
+  auto range = req ? req->get_header("Range") : std::nullopt;
+  // If-Range holds the validator the client has, a stale one means the whole file is wanted
+  if (auto if_range = req && range ? req->get_header("If-Range") : std::nullopt) {
+    std::string_view validator = trim(*if_range);
+    if (validator != etag && validator != last_modified) range = std::nullopt;
+  }
+  if (range) {
+    switch (parse_range(*range, size, first, len)) {
+    case range_result::OK:
+      res.m_status = status::PARTIAL_CONTENT;
+      res.set_header("Content-Range", "bytes " + std::to_string(first) + "-" + std::to_string(first + len - 1) + "/" + std::to_string(size));
+      break;
+    case range_result::UNSATISFIABLE: {
+      response unsatisfiable = ok(status::RANGE_NOT_SATISFIABLE);
+      unsatisfiable.set_header("Content-Range", "bytes */" + std::to_string(size));
+      return unsatisfiable;
+    }
+    case range_result::NONE: break;
+    }
+  }
+
+  if (0 == len) return res;
+  if (cached) {
+    // a view into the cached bytes, which the segment keeps alive
+    res.m_body.push_back({std::string_view(*cached->m_data).substr(first, len), cached->m_data});
+    return res;
+  }
+  int fd = ::open(target.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return ok(status::NOT_FOUND);
+  res.m_file = file_part{std::make_shared<open_file>(fd), fd, (int64_t)first, len};
+  return res;
+}
+
+path_handler static_handler(const std::string prefix, const std::filesystem::path dir) {
+  size_t nprefix = 0;
+  std::string_view rest = prefix, segment;
+  while (next_segment(rest, segment)) nprefix++;
+
+  return [nprefix, dir](request &req) {
+    std::string_view path = req.get_path(), segment;
+    for (size_t i = 0; i < nprefix; i++) next_segment(path, segment);
+    std::filesystem::path file = dir;
+    std::string name;
+    while (next_segment(path, segment)) {
+      // nothing outside of 'dir' is ever reachable
+      if (!percent_decode(segment, name) || name == "." || name == ".." || name.find_first_of(std::string_view("/\0", 2)) != std::string::npos) {
+        return response::ok(status::NOT_FOUND);
+      }
+      file /= name;
+    }
+    struct stat st;
+    if (0 == ::stat(file.c_str(), &st) && S_ISDIR(st.st_mode)) file /= FC_STATIC_INDEX;
+    return response::send(req, file);
+  };
+}
+
+} // namespace fc
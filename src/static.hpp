@@ -0,0 +1,17 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+#include "include/fc.hpp"
+
+#define FC_STATIC_CACHE_MAX_FILE (1024 * 64)         // 64 KB, larger files are sent with sendfile
+#define FC_STATIC_CACHE_MAX_BYTES (1024 * 1024 * 32) // 32 MB per worker, each one keeps its own copies
+#define FC_STATIC_INDEX "index.html"
+
+namespace fc {
+
+// Handler serving the files under 'dir' for the requests under 'prefix', see 'app::serve_static'
+path_handler static_handler(const std::string prefix, const std::filesystem::path dir);
+
+} // namespace fc
@@ -0,0 +1,51 @@
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include "conn.hpp"
+#include "include/fc.hpp"
+#include "stream.hpp"
+#include "worker.hpp"
+
+namespace fc {
+
+bool body_stream::write(std::string chunk) const {
+  if (m_state->m_closed.load()) return false;
+  if (chunk.empty()) return true;
+  bool post;
+  {
+    std::lock_guard<std::mutex> lock(m_state->m_mutex);
+    if (m_state->m_ended) return false;
+    m_state->m_queued += chunk.size();
+    m_state->m_chunks.push_back(std::move(chunk));
+    post = !m_state->m_posted;
+    m_state->m_posted = true;
+  }
+  if (post) m_state->m_worker->post_stream(m_state);
+  return true;
+}
+
+void body_stream::end() const {
+  bool post;
+  {
+    std::lock_guard<std::mutex> lock(m_state->m_mutex);
+    if (m_state->m_ended) return;
+    m_state->m_ended = true;
+    post = !m_state->m_posted;
+    m_state->m_posted = true;
+  }
+  if (post) m_state->m_worker->post_stream(m_state);
+}
+
+bool body_stream::ready() const { return !m_state->m_closed.load() && m_state->m_queued.load() < FC_STREAM_HIGH_WATER; }
+
+response response::stream(request &req, std::function<void(body_stream &)> pull) {
+  connection *conn = (connection *)req.get_remote();
+  if (!conn) throw std::runtime_error("Request is not bound to a connection");
+  response res(status::OK, nullptr);
+  res.m_stream = std::make_shared<body_stream::state>((worker *)conn->m_handle.loop->data, std::move(pull));
+  return res;
+}
+
+} // namespace fc
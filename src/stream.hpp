@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "include/fc.hpp"
+
+#define FC_STREAM_HIGH_WATER (1024 * 64) // bytes queued before 'body_stream::ready' turns false
+#define FC_STREAM_LOW_WATER (1024 * 16)  // the producer is pulled again once the queue drained below this
+
+namespace fc {
+
+struct worker;
+struct connection;
+
+struct body_stream::state {
+public:
+  worker *m_worker;
+  std::function<void(body_stream &)> m_pull;
+  // bytes written to the stream and not yet flushed to the socket
+  std::atomic<size_t> m_queued;
+  // the client went away or the stream is over, writes are refused
+  std::atomic<bool> m_closed;
+
+  std::mutex m_mutex;
+  std::vector<std::string> m_chunks; // written, not yet handed to the loop
+  bool m_ended;                      // 'end' was called
+  bool m_posted;                     // waiting in the worker queue to be flushed
+
+  // loop only: null until the response is sent and again once the connection is gone
+  connection *m_conn;
+  bool m_started;   // the head was written, chunks can follow
+  bool m_chunked;   // false for HTTP/1.0 clients, the body is delimited by closing the connection
+  bool m_sent_last; // the last chunk was handed to 'uv_write'
+
+  state(worker *worker, std::function<void(body_stream &)> pull)
+      : m_worker(worker), m_pull(std::move(pull)), m_queued(0), m_closed(false), m_ended(false), m_posted(false), m_conn(nullptr), m_started(false), m_chunked(true), m_sent_last(false) {}
+  state(const state &) = delete;
+};
+
+} // namespace fc
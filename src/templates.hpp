@@ -3,19 +3,17 @@
 namespace fc {
 namespace templates {
 
-constexpr char OK_RESPONSE[] = "HTTP/1.1 {} {}\r\n"
-                               "Server: Falcon\r\n"
-                               "Content-Type: text/plain\r\n"
-                               "Content-Length: {}\r\n"
-                               "\r\n"
-                               "{}";
+// header lines every response starts with, the status line comes from 'status_line'
+constexpr char SERVER[] = "Server: Falcon\r\n";
+constexpr char CONTENT_TYPE_TEXT[] = "Content-Type: text/plain\r\n";
+constexpr char CONTENT_TYPE_JSON[] = "Content-Type: application/json\r\n";
 
-constexpr char HTTP_RESPONSE_FORMAT[] = "HTTP/1.1 {} {}\r\n"
-                                        "Server: Falcon\r\n"
-                                        "Content-Type: {}\r\n"
-                                        "Content-Length: {}\r\n"
-                                        "\r\n"
-                                        "{}";
+constexpr char CONNECTION_CLOSE[] = "Connection: close\r\n";
+constexpr char CONNECTION_KEEP_ALIVE[] = "Connection: keep-alive\r\n";
+
+// chunked transfer coding, each chunk is followed by a CRLF and the body ends with an empty chunk
+constexpr char CRLF[] = "\r\n";
+constexpr char LAST_CHUNK[] = "0\r\n\r\n";
 
 } // namespace templates
 } // namespace fc
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define FC_TIMER_TICK (100)   // ms, resolution of the connection timeouts
+#define FC_TIMER_SLOTS (1024) // a power of two, about 100 s per revolution at the default tick
+
+namespace fc {
+
+// What a connection is being timed for, see 'worker::arm_timeout'
+enum class timeout : unsigned char { NONE, HEADER, BODY, IDLE, WRITE, COUNT };
+
+// Node of a 'timer_wheel', lives in what it times so scheduling never allocates
+struct timer_entry {
+public:
+  timer_entry *m_prev = nullptr; // both null while not scheduled
+  timer_entry *m_next = nullptr;
+  uint64_t m_deadline = 0; // tick
+  timeout m_kind = timeout::NONE;
+  void *m_data = nullptr;
+};
+
+// Hashed timing wheel owned by one loop. An entry sits in the slot of its deadline modulo the
+// number of slots, so scheduling and cancelling are O(1) and a tick only walks the slot it
+// reaches, whatever the number of idle entries. Entries more than one revolution away stay in
+// their slot and are skipped until their round comes.
+struct timer_wheel {
+public:
+  std::vector<timer_entry> m_slots; // list heads, each linked to itself when empty
+  uint64_t m_now;                   // ticks so far
+  size_t m_size;
+
+  timer_wheel() : m_slots(FC_TIMER_SLOTS), m_now(0), m_size(0) {
+    for (timer_entry &head : m_slots) head.m_prev = head.m_next = &head;
+  }
+  timer_wheel(const timer_wheel &) = delete;
+  timer_wheel &operator=(const timer_wheel &) = delete;
+
+  // (re)schedules 'entry' to expire after 'ticks' full ticks, the one running now not counting
+  void schedule(timer_entry *entry, timeout kind, uint64_t ticks) {
+    cancel(entry);
+    entry->m_kind = kind;
+    entry->m_deadline = m_now + ticks + 1;
+    timer_entry &head = m_slots[entry->m_deadline & (FC_TIMER_SLOTS - 1)];
+    entry->m_prev = head.m_prev;
+    entry->m_next = &head;
+    head.m_prev->m_next = entry;
+    head.m_prev = entry;
+    m_size++;
+  }
+
+  void cancel(timer_entry *entry) {
+    if (!entry->m_prev) return;
+    entry->m_prev->m_next = entry->m_next;
+    entry->m_next->m_prev = entry->m_prev;
+    entry->m_prev = entry->m_next = nullptr;
+    entry->m_kind = timeout::NONE;
+    m_size--;
+  }
+
+  // Moves one tick forward and calls 'expired(entry, kind)' for every entry due, each one is
+  // unlinked first so the callback may schedule it again. It must not cancel any other entry.
+  template <typename F> void tick(F expired) {
+    m_now++;
+    timer_entry &head = m_slots[m_now & (FC_TIMER_SLOTS - 1)];
+    for (timer_entry *entry = head.m_next; entry != &head;) {
+      timer_entry *next = entry->m_next;
+      if (entry->m_deadline <= m_now) {
+        timeout kind = entry->m_kind;
+        cancel(entry);
+        expired(entry, kind);
+      }
+      entry = next;
+    }
+  }
+};
+
+} // namespace fc
@@ -0,0 +1,801 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <uv.h>
+#include <vector>
+
+#include "external/llhttp/llhttp.h"
+
+#include "conn.hpp"
+#include "http.hpp"
+#include "include/fc.hpp"
+#include "req.hpp"
+#include "templates.hpp"
+#include "worker.hpp"
+
+namespace fc {
+
+// keeps the response, and the header block written for it, alive until libuv is done writing them
+struct write_ctx {
+  uv_write_t m_req;
+  uv_fs_t m_fs; // sends the file part, once the header block and body segments were written
+  std::string m_head;
+  response m_res;
+  unsigned m_route;
+  uint64_t m_started;
+  size_t m_bytes_in;
+  // preserialized message written in place of the head and body, see 'canned_response'
+  std::string_view m_canned;
+};
+
+// body compressed on the thread pool, the connection waits meanwhile as for a deferred request
+struct compress_ctx {
+  uv_work_t m_work;
+  connection *m_conn;
+  response m_res;
+  content_coding m_coding;
+  int m_level;
+};
+
+// chunks of a streamed body handed to a single 'uv_write', with the framing around them
+struct stream_write {
+  uv_write_t m_req;
+  decltype(connection::m_stream) m_stream;
+  std::vector<std::string> m_chunks;
+  std::vector<std::array<char, 20>> m_sizes; // "<hex length>\r\n" of every chunk
+  size_t m_bytes;
+  bool m_last;
+};
+
+// Connection header of the next response: HTTP/1.0 clients only keep the connection open when
+// told so, the last response of a connection announces it is closed
+static conn_header conn_header_of(const connection *conn) {
+  if (!conn->m_keep_alive) return conn_header::CLOSE;
+  if (0 == conn->m_http_minor) return conn_header::KEEP_ALIVE;
+  return conn_header::NONE;
+}
+
+static const char *const CONN_LINES[] = {"", templates::CONNECTION_CLOSE, templates::CONNECTION_KEEP_ALIVE};
+
+// buffers handed to a single 'uv_write' without going to the heap, libuv copies the array
+#define FC_WRITE_INLINE_BUFS (8)
+
+int worker::bind(const struct sockaddr *addr, bool reuse_port) {
+  int result = uv_tcp_init_ex(m_loop, &m_host_sock, addr->sa_family);
+  if (result) return result;
+  if (reuse_port) {
+    // every worker binds its own socket to the same port and the kernel spreads incoming connections between them
+    uv_os_fd_t fd;
+    int on = 1;
+    uv_fileno((uv_handle_t *)&m_host_sock, &fd);
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on))) return uv_translate_sys_error(errno);
+  }
+  result = uv_tcp_bind(&m_host_sock, addr, 0);
+  if (result) return result;
+  return uv_listen((uv_stream_t *)&m_host_sock, m_settings.m_backlog, worker::on_connection);
+}
+
+void worker::close() {
+  uv_walk(
+      m_loop,
+      [](uv_handle_t *handle, void *arg) {
+        worker *self = (worker *)arg;
+        if (uv_is_closing(handle)) return;
+        // every other tcp handle is the first member of a connection
+        if (handle->type == UV_TCP && handle != (uv_handle_t *)&self->m_host_sock) return self->close_connection((connection *)handle);
+        uv_close(handle, nullptr);
+      },
+      this);
+  uv_run(m_loop, UV_RUN_DEFAULT);
+}
+
+void worker::on_connection(uv_stream_t *host, int status) {
+  if (status < 0) {
+    std::cerr << "[FALCON ERROR]: Failed to accept new connection, " << uv_strerror(status) << std::endl;
+    return;
+  }
+  worker *self = (worker *)host->loop->data;
+  if (self->m_settings.m_max_connections && self->m_nconnections >= self->m_settings.m_max_connections) {
+    // Left unaccepted libuv stops polling the socket, later clients wait in the kernel backlog
+    // and are taken in as connections go away ('free_connection')
+    self->m_accept_paused = true;
+    bump(self->m_stats.m_accept_pauses);
+    return;
+  }
+  self->accept_connection();
+}
+
+void worker::accept_connection() {
+  bump(m_stats.m_accepted);
+  m_nconnections++;
+  connection *conn = new connection(m_settings.m_max_header_size, m_settings.m_max_body_size, &m_read_pool);
+  uv_tcp_init(m_loop, &conn->m_handle);
+  conn->m_handle.data = conn;
+  conn->m_timer.m_data = conn;
+  conn->m_open_handles = 1;
+  int result = uv_accept((uv_stream_t *)&m_host_sock, (uv_stream_t *)&conn->m_handle);
+  if (result != 0) {
+    std::cerr << "[FALCON ERROR]: Failed to accept new connection, " << uv_strerror(result) << std::endl;
+    return close_connection(conn);
+  }
+  uv_read_start((uv_stream_t *)&conn->m_handle, worker::on_alloc_buf, worker::on_read_buf);
+  // the first request head has to come in before the header timeout, not the keep-alive one
+  arm_timeout(conn);
+}
+
+bool worker::should_shed(connection *conn) {
+  // requests still waiting on their handler, deferred or offloaded, are what piles up in a loop
+  if (m_settings.m_max_in_flight && m_in_flight >= m_settings.m_max_in_flight) return true;
+  if (!m_settings.m_shed_target) return false;
+  uint64_t now = uv_hrtime();
+  return m_codel.shed(now > conn->m_read_at ? now - conn->m_read_at : 0, now);
+}
+
+void worker::on_alloc_buf(uv_handle_t *client, size_t size, uv_buf_t *buf) {
+  connection *conn = (connection *)client;
+  ((worker *)client->loop->data)->reserve_input(conn);
+  // reads always land right after the bytes kept from the previous one, so a split message stays contiguous
+  *buf = uv_buf_init(conn->m_inbuf + conn->m_inbuf_len, conn->m_inbuf_cap - conn->m_inbuf_len);
+}
+
+void worker::on_read_buf(uv_stream_t *client, long nread, const uv_buf_t *buf) {
+  connection *conn = (connection *)client;
+  worker *self = (worker *)client->loop->data;
+  if (nread < 0) {
+    if (nread != UV_EOF) {
+      std::cerr << "[FALCON ERROR]: Failed to read remote socket, " << uv_strerror(nread) << std::endl;
+      bump(self->m_stats.m_read_errors);
+    }
+    return self->close_connection(conn);
+  }
+  conn->m_inbuf_len += nread;
+  // when the poll that reported the read returned, the callbacks run before this one are part of
+  // the wait: a loop falling behind shows in here, a stamp taken now would always be fresh
+  if (self->m_settings.m_shed_target) conn->m_read_at = uv_now(self->m_loop) * 1000000;
+  self->parse_http_request(conn);
+  self->arm_timeout(conn, true);
+}
+
+void worker::reserve_input(connection *conn) {
+  if (!conn->m_inbuf) {
+    conn->m_inbuf = m_read_pool.acquire(m_read_pool.m_slab_size);
+    conn->m_inbuf_cap = m_read_pool.m_slab_size;
+    return;
+  }
+  if (conn->m_inbuf_cap - conn->m_inbuf_len >= FC_MIN_READ_SIZE) return;
+  if (conn->m_req && conn->m_parser.m_headers_complete && !conn->m_head_buf) {
+    // only body bytes are left to read, chain a fresh slab instead of growing this one
+    conn->m_head_buf = conn->m_inbuf;
+    conn->m_head_cap = conn->m_inbuf_cap;
+    conn->m_head_len = conn->m_inbuf_len;
+    conn->m_parser.m_copy_body = true;
+    conn->m_inbuf = m_read_pool.acquire(m_read_pool.m_slab_size);
+    conn->m_inbuf_cap = m_read_pool.m_slab_size;
+    conn->m_inbuf_len = conn->m_inbuf_parsed = 0;
+    return;
+  }
+  // the request head doesn't fit in one slab, it has to stay contiguous so the buffer grows,
+  // the header size limit enforced by the parser bounds how far this goes
+  size_t cap = std::max(conn->m_inbuf_cap * 2, conn->m_inbuf_len + m_read_pool.m_slab_size);
+  char *inbuf = m_read_pool.acquire(cap);
+  memcpy(inbuf, conn->m_inbuf, conn->m_inbuf_len);
+  if (conn->m_req) http_parser::rebase(&*conn->m_req, conn->m_inbuf, conn->m_inbuf_len, inbuf);
+  m_read_pool.release(conn->m_inbuf, conn->m_inbuf_cap);
+  conn->m_inbuf = inbuf;
+  conn->m_inbuf_cap = cap;
+}
+
+void worker::release_input(connection *conn) {
+  conn->m_arena.release();
+  m_read_pool.release(conn->m_inbuf, conn->m_inbuf_cap);
+  m_read_pool.release(conn->m_head_buf, conn->m_head_cap);
+  conn->m_inbuf = conn->m_head_buf = nullptr;
+  conn->m_inbuf_cap = conn->m_inbuf_len = conn->m_inbuf_parsed = 0;
+  conn->m_head_cap = conn->m_head_len = 0;
+}
+
+void worker::parse_http_request(connection *conn) {
+  // pipelined requests are answered in the order they were read, 'uv_write' keeps the queue ordered
+  const char *base = conn->m_inbuf;
+  size_t msg_start = conn->m_inbuf_answered;
+  conn->m_inbuf_answered = 0;
+  while (conn->m_keep_alive && conn->m_inbuf_parsed < conn->m_inbuf_len) {
+    if (!conn->m_req) conn->m_req.emplace(request_factory((void *)conn, {}, &conn->m_arena));
+    size_t nparsed = 0;
+    enum llhttp_errno err = conn->m_parser.execute(&*conn->m_req, base + conn->m_inbuf_parsed, conn->m_inbuf_len - conn->m_inbuf_parsed, &nparsed);
+    conn->m_inbuf_parsed += nparsed;
+    if (HPE_OK == err) break;
+    if (HPE_PAUSED != err) {
+      // the parser can't find the start of the next message, so the connection is dropped
+      std::cerr << "[FALCON ERROR]: Faild to parse request, " << llhttp_errno_name(err) << std::endl;
+      conn->m_keep_alive = false;
+      conn->m_http_minor = conn->m_req->m_http_minor;
+      conn->m_route = 0;
+      conn->m_started = uv_hrtime();
+      conn->m_bytes_in = conn->m_inbuf_parsed - msg_start;
+      send_error(conn, conn->m_parser.m_error);
+      conn->m_req.reset();
+      conn->m_arena.reset();
+      break;
+    }
+    if (conn->m_head_buf) {
+      // the body spilled over into other slabs, only the head is left in the raw view
+      conn->m_req->m_raw = std::string_view(conn->m_head_buf, conn->m_head_len);
+    } else {
+      conn->m_req->m_raw = std::string_view(base + msg_start, conn->m_inbuf_parsed - msg_start);
+    }
+    msg_start = conn->m_inbuf_parsed;
+    match_request_to_handler(conn, *conn->m_req);
+    // the request and its memory stay as they are until its deferred response comes in
+    if (conn->m_deferred) break;
+    end_request(conn);
+  }
+  if (conn->m_deferred) {
+    // nothing is read meanwhile, the buffer holding the request must not move
+    conn->m_inbuf_answered = msg_start;
+    uv_read_stop((uv_stream_t *)&conn->m_handle);
+    return;
+  }
+  if (!conn->m_req || !conn->m_keep_alive) {
+    conn->m_req.reset();
+    return release_input(conn);
+  }
+  if (conn->m_head_buf) {
+    // every byte of this slab was parsed and copied into the request body, it can be reused as is
+    conn->m_inbuf_len = conn->m_inbuf_parsed = 0;
+    return;
+  }
+  // keep the unfinished message at the front of the buffer, everything before it was answered
+  if (msg_start > 0) {
+    memmove(conn->m_inbuf, conn->m_inbuf + msg_start, conn->m_inbuf_len - msg_start);
+    http_parser::rebase(&*conn->m_req, conn->m_inbuf + msg_start, conn->m_inbuf_len - msg_start, conn->m_inbuf);
+    conn->m_inbuf_len -= msg_start;
+    conn->m_inbuf_parsed -= msg_start;
+  }
+}
+
+void worker::end_request(connection *conn) {
+  // the response owns its bytes, nothing allocated for the request is needed anymore
+  conn->m_req.reset();
+  conn->m_arena.reset();
+  if (conn->m_head_buf) {
+    m_read_pool.release(conn->m_head_buf, conn->m_head_cap);
+    conn->m_head_buf = nullptr;
+    conn->m_head_cap = conn->m_head_len = 0;
+  }
+}
+
+void worker::match_request_to_handler(connection *conn, request &req) {
+  conn->m_nrequests++;
+  conn->m_http_minor = req.m_http_minor;
+  if (!req.m_keep_alive || (m_settings.m_max_requests_per_conn && conn->m_nrequests >= m_settings.m_max_requests_per_conn)) {
+    conn->m_keep_alive = false;
+  }
+  conn->m_route = 0;
+  if (m_settings.m_compression_level) {
+    auto accept = req.get_header(header::ACCEPT_ENCODING);
+    conn->m_coding = accept ? negotiate_coding(*accept) : content_coding::IDENTITY;
+  }
+  if (m_stats.m_routes) {
+    conn->m_started = uv_hrtime();
+    // a body that spilled over into other slabs is not part of the raw view
+    conn->m_bytes_in = req.m_raw.size() + (conn->m_head_buf ? req.m_raw_body.size() : 0);
+  }
+  req.m_max_json_size = m_settings.m_max_json_size;
+  req.m_max_json_depth = m_settings.m_max_json_depth;
+  if ((m_settings.m_max_in_flight || m_settings.m_shed_target) && should_shed(conn)) {
+    bump(m_stats.m_shed);
+    return send_error(conn, status::SERVICE_UNAVAILABLE);
+  }
+  conn->m_in_flight = true;
+  m_in_flight++;
+  try {
+    if (std::optional<response> res; m_router.dispatch_static(req, res)) {
+      conn->m_route = metrics::route_of(req);
+      return send_handler_response(conn, std::move(*res));
+    }
+    unsigned allowed = 0;
+    if (m_router.match(req, &allowed)) {
+      conn->m_route = metrics::route_of(req);
+      return send_handler_response(conn, req.next());
+    }
+    if (allowed) return send_canned(conn, status::METHOD_NOT_ALLOWED, canned_not_allowed(allowed, conn_header_of(conn)));
+  } catch (const http_error &e) {
+    conn->m_route = metrics::route_of(req);
+    // a deferred request is answered by its responder, a 500 once every copy of it is gone
+    if (conn->m_deferred) return;
+    return send_error(conn, e.get_status());
+  } catch (const std::exception &e) {
+    std::cerr << "[FALCON ERROR]: Request handler failed, " << e.what() << std::endl;
+    conn->m_route = metrics::route_of(req);
+    if (conn->m_deferred) return;
+    return send_error(conn, status::INTERNAL_SERVER_ERROR);
+  } catch (...) {
+    std::cerr << "[FALCON ERROR]: Request handler failed" << std::endl;
+    conn->m_route = metrics::route_of(req);
+    if (conn->m_deferred) return;
+    return send_error(conn, status::INTERNAL_SERVER_ERROR);
+  }
+  send_error(conn, status::NOT_FOUND);
+}
+
+void worker::send_handler_response(connection *conn, response res) {
+  if (conn->m_deferred) {
+    // answered later through the responder the handler got from 'request::defer'
+    if (!res.m_pending) std::cerr << "[FALCON ERROR]: Deferred request handler returned a response, it is ignored" << std::endl;
+    return;
+  }
+  if (res.m_pending) {
+    std::cerr << "[FALCON ERROR]: Handler returned a pending response without deferring the request" << std::endl;
+    return send_error(conn, status::INTERNAL_SERVER_ERROR);
+  }
+  if (res.m_stream) return start_stream(conn, std::move(res));
+  if (compress_response(conn, res)) return;
+  send_response(conn, std::move(res));
+}
+
+bool worker::compress_response(connection *conn, response &res) {
+  if (!m_settings.m_compression_level || !compression::eligible(res, m_settings.m_compression_min_size)) return false;
+  if (conn->m_coding == content_coding::IDENTITY) {
+    // caches must not hand this response to a client that takes compressed ones, nor the reverse
+    compression::add_vary(res);
+    return false;
+  }
+  if (!m_settings.m_compression_offload_size || res.content_length() < m_settings.m_compression_offload_size) {
+    compression::apply(res, conn->m_coding, m_settings.m_compression_level);
+    return false;
+  }
+  // a large body would stall every other connection of the loop, it is compressed on the thread
+  // pool and comes back through 'complete_deferred'
+  conn->m_deferred = true;
+  compress_ctx *ctx = new compress_ctx{{}, conn, std::move(res), conn->m_coding, m_settings.m_compression_level};
+  ctx->m_work.data = ctx;
+  uv_queue_work(m_loop, &ctx->m_work, worker::on_compress_work, worker::on_compress_done);
+  return true;
+}
+
+void worker::post_deferred(connection *conn, response res) {
+  {
+    std::lock_guard<std::mutex> lock(m_completed_mutex);
+    m_completed.emplace_back(conn, std::move(res));
+  }
+  uv_async_send(&m_completed_async);
+}
+
+void worker::complete_deferred(connection *conn, response res) {
+  conn->m_deferred = false;
+  if (conn->m_closing) {
+    // its handles are closed already, the connection was only kept for this response
+    if (0 == conn->m_open_handles && !conn->m_file_ctx) free_connection(conn);
+    return;
+  }
+  if (res.m_stream) return start_stream(conn, std::move(res));
+  if (compress_response(conn, res)) return;
+  send_response(conn, std::move(res));
+  end_request(conn);
+  // requests pipelined behind the deferred one were left in the buffer
+  if (conn->m_keep_alive) {
+    uv_read_start((uv_stream_t *)&conn->m_handle, worker::on_alloc_buf, worker::on_read_buf);
+  }
+  parse_http_request(conn);
+}
+
+void worker::start_stream(connection *conn, response res) {
+  auto stream = res.m_stream;
+  stream->m_conn = conn;
+  stream->m_chunked = conn->m_http_minor > 0;
+  if (stream->m_chunked) {
+    res.set_header("Transfer-Encoding", "chunked");
+  } else {
+    // an HTTP/1.0 client reads the body until the connection closes
+    conn->m_keep_alive = false;
+  }
+  // nothing else is parsed until the stream ended, as for a deferred request
+  conn->m_deferred = true;
+  conn->m_stream = stream;
+  for (auto &seg : res.m_body) body_stream(stream).write(std::string(seg.m_data));
+  res.m_body.clear();
+  send_response(conn, std::move(res));
+}
+
+void worker::post_stream(std::shared_ptr<body_stream::state> stream) {
+  {
+    std::lock_guard<std::mutex> lock(m_completed_mutex);
+    m_streams.push_back(std::move(stream));
+  }
+  uv_async_send(&m_completed_async);
+}
+
+void worker::pull_stream(const std::shared_ptr<body_stream::state> &stream) {
+  if (!stream->m_conn) return;
+  if (stream->m_pull) {
+    body_stream writer(stream);
+    try {
+      stream->m_pull(writer);
+    } catch (const std::exception &e) {
+      // the head is out already, the client only learns from the connection closing early
+      std::cerr << "[FALCON ERROR]: Stream producer failed, " << e.what() << std::endl;
+      if (stream->m_conn) close_connection(stream->m_conn);
+      return;
+    }
+  }
+  // what the producer wrote goes out right away rather than on the next loop iteration
+  flush_stream(stream);
+}
+
+void worker::flush_stream(const std::shared_ptr<body_stream::state> &stream) {
+  connection *conn = stream->m_conn;
+  // chunks written before the head went out wait for it
+  if (!conn || !stream->m_started || stream->m_sent_last) return;
+  std::vector<std::string> chunks;
+  bool last;
+  {
+    std::lock_guard<std::mutex> lock(stream->m_mutex);
+    chunks.swap(stream->m_chunks);
+    last = stream->m_ended;
+    stream->m_posted = false;
+  }
+  if (chunks.empty() && !last) return;
+
+  stream_write *w = new stream_write{{}, stream, std::move(chunks), {}, 0, last};
+  std::vector<uv_buf_t> bufs;
+  bufs.reserve(w->m_chunks.size() * 3 + 1);
+  w->m_sizes.resize(stream->m_chunked ? w->m_chunks.size() : 0);
+  for (size_t i = 0; i < w->m_chunks.size(); i++) {
+    std::string &chunk = w->m_chunks[i];
+    w->m_bytes += chunk.size();
+    if (stream->m_chunked) {
+      int len = std::snprintf(w->m_sizes[i].data(), w->m_sizes[i].size(), "%zx\r\n", chunk.size());
+      bufs.push_back(uv_buf_init(w->m_sizes[i].data(), len));
+    }
+    bufs.push_back(uv_buf_init(chunk.data(), chunk.size()));
+    if (stream->m_chunked) bufs.push_back(uv_buf_init((char *)templates::CRLF, 2));
+  }
+  if (last) {
+    stream->m_sent_last = true;
+    if (stream->m_chunked) bufs.push_back(uv_buf_init((char *)templates::LAST_CHUNK, sizeof(templates::LAST_CHUNK) - 1));
+  }
+  w->m_req.data = w;
+  uv_write(&w->m_req, (uv_stream_t *)&conn->m_handle, bufs.data(), bufs.size(), worker::on_stream_write);
+  arm_timeout(conn);
+}
+
+void worker::end_stream(connection *conn) {
+  conn->m_stream->m_conn = nullptr;
+  conn->m_stream->m_closed = true;
+  conn->m_stream.reset();
+  conn->m_deferred = false;
+  if (!conn->m_keep_alive) return close_connection(conn);
+  end_request(conn);
+  // requests pipelined behind the streamed one were left in the buffer
+  uv_read_start((uv_stream_t *)&conn->m_handle, worker::on_alloc_buf, worker::on_read_buf);
+  parse_http_request(conn);
+  arm_timeout(conn, true);
+}
+
+void worker::send_response(connection *conn, response res) {
+  if (res.m_canned) return send_error(conn, res.m_status);
+  write_ctx *ctx = new write_ctx{{}, {}, {}, std::move(res), conn->m_route, conn->m_started, conn->m_bytes_in, {}};
+  if (ctx->m_res.m_serialized) {
+    // only what goes between the serialized head and body, see 'write_response'
+    ctx->m_head.append(CONN_LINES[static_cast<size_t>(conn_header_of(conn))]).append(templates::CRLF);
+  } else {
+    ctx->m_res.write_head(ctx->m_head, CONN_LINES[static_cast<size_t>(conn_header_of(conn))]);
+  }
+  schedule_write(conn, ctx);
+}
+
+void worker::send_error(connection *conn, status status) {
+  std::string_view message = canned_response(status, conn_header_of(conn));
+  if (message.empty()) return send_response(conn, response::ok(status));
+  send_canned(conn, status, message);
+}
+
+void worker::send_canned(connection *conn, status status, std::string_view message) {
+  // the response only carries the status for the metrics, the bytes all come from 'message'
+  write_ctx *ctx = new write_ctx{{}, {}, {}, response(status, nullptr), conn->m_route, conn->m_started, conn->m_bytes_in, message};
+  schedule_write(conn, ctx);
+}
+
+void worker::schedule_write(connection *conn, write_ctx *ctx) {
+  if (conn->m_in_flight) {
+    conn->m_in_flight = false;
+    m_in_flight--;
+  }
+  conn->m_pending_writes++;
+  if (conn->m_file_ctx) {
+    conn->m_outq.push_back(ctx);
+  } else {
+    write_response(conn, ctx);
+  }
+  if (!conn->m_keep_alive) uv_read_stop((uv_stream_t *)&conn->m_handle);
+  arm_timeout(conn);
+}
+
+void worker::write_response(connection *conn, write_ctx *ctx) {
+  ctx->m_req.data = ctx;
+  if (!ctx->m_canned.empty()) {
+    uv_buf_t buf = uv_buf_init((char *)ctx->m_canned.data(), ctx->m_canned.size());
+    uv_write(&ctx->m_req, (uv_stream_t *)&conn->m_handle, &buf, 1, worker::on_write_response);
+    return;
+  }
+  if (ctx->m_res.m_serialized) {
+    const std::string &message = *ctx->m_res.m_serialized;
+    size_t head = ctx->m_res.m_serialized_head;
+    uv_buf_t bufs[3] = {uv_buf_init((char *)message.data(), head), uv_buf_init(ctx->m_head.data(), ctx->m_head.size()), uv_buf_init((char *)message.data() + head, message.size() - head)};
+    uv_write(&ctx->m_req, (uv_stream_t *)&conn->m_handle, bufs, 3, worker::on_write_response);
+    return;
+  }
+  // header block first, then the body segments straight from where they live
+  size_t nbufs = 1 + ctx->m_res.m_body.size();
+  uv_buf_t inline_bufs[FC_WRITE_INLINE_BUFS];
+  std::vector<uv_buf_t> heap_bufs;
+  uv_buf_t *bufs = inline_bufs;
+  if (nbufs > FC_WRITE_INLINE_BUFS) {
+    heap_bufs.resize(nbufs);
+    bufs = heap_bufs.data();
+  }
+  bufs[0] = uv_buf_init(ctx->m_head.data(), ctx->m_head.length());
+  for (size_t i = 1; i < nbufs; i++) {
+    const auto &seg = ctx->m_res.m_body[i - 1].m_data;
+    bufs[i] = uv_buf_init((char *)seg.data(), seg.length());
+  }
+  if (ctx->m_res.m_file) conn->m_file_ctx = ctx;
+  uv_write(&ctx->m_req, (uv_stream_t *)&conn->m_handle, bufs, nbufs, worker::on_write_response);
+}
+
+void worker::finish_write(connection *conn, write_ctx *ctx, int status) {
+  if (m_stats.m_routes && status >= 0) {
+    m_stats.record(ctx->m_route, ctx->m_res.m_status, ctx->m_bytes_in, ctx->m_head.size() + ctx->m_res.m_serialized_head + ctx->m_res.content_length() + ctx->m_canned.size(), uv_hrtime() - ctx->m_started);
+  }
+  bool stream_head = ctx->m_res.m_stream != nullptr;
+  delete ctx;
+  conn->m_pending_writes--;
+  if (status < 0) {
+    if (status != UV_ECANCELED)
+      std::cerr << "[FALCON ERROR]: Failed to write response, " << uv_strerror(status) << std::endl;
+    return close_connection(conn);
+  }
+  if (stream_head) {
+    // the body follows the head, the connection is left as is until the stream ended
+    conn->m_stream->m_started = true;
+    return pull_stream(conn->m_stream);
+  }
+  if (0 == conn->m_pending_writes && !conn->m_stream && !conn->m_keep_alive) return close_connection(conn);
+  // what is still queued made progress, or the connection now waits for the next request
+  arm_timeout(conn, true);
+}
+
+void worker::send_file(connection *conn) {
+  write_ctx *ctx = conn->m_file_ctx;
+  const auto &file = *ctx->m_res.m_file;
+  uv_os_fd_t sock;
+  uv_fileno((uv_handle_t *)&conn->m_handle, &sock);
+  ctx->m_fs.data = conn;
+  int result = uv_fs_sendfile(m_loop, &ctx->m_fs, sock, file.m_fd, file.m_offset, file.m_length, worker::on_sendfile);
+  if (result < 0) end_file(conn, result);
+}
+
+void worker::end_file(connection *conn, int status) {
+  write_ctx *ctx = conn->m_file_ctx;
+  conn->m_file_ctx = nullptr;
+  if (conn->m_closing) {
+    delete ctx;
+    conn->m_pending_writes--;
+    // its handles are closed already, the connection was only kept for this sendfile
+    if (0 == conn->m_open_handles && !conn->m_deferred) free_connection(conn);
+    return;
+  }
+  // responses held back behind the file go out now, until one of them has a file part again
+  while (0 == status && !conn->m_outq.empty() && !conn->m_file_ctx) {
+    write_ctx *next = conn->m_outq.front();
+    conn->m_outq.pop_front();
+    write_response(conn, next);
+  }
+  finish_write(conn, ctx, status);
+}
+
+void worker::close_connection(connection *conn) {
+  if (conn->m_closing) return;
+  conn->m_closing = true;
+  if (conn->m_in_flight) {
+    // a deferred response coming in later is dropped
+    conn->m_in_flight = false;
+    m_in_flight--;
+  }
+  if (conn->m_stream) {
+    // the producer finds out from 'body_stream::write' returning false
+    conn->m_stream->m_conn = nullptr;
+    conn->m_stream->m_closed = true;
+    conn->m_stream.reset();
+    conn->m_deferred = false;
+  }
+  // never handed to libuv, nobody else would free them
+  for (write_ctx *ctx : conn->m_outq) delete ctx;
+  conn->m_pending_writes -= conn->m_outq.size();
+  conn->m_outq.clear();
+  m_timers.cancel(&conn->m_timer);
+  uv_close((uv_handle_t *)&conn->m_handle, worker::on_close_conn);
+}
+
+void worker::arm_timeout(connection *conn, bool progress) {
+  timeout kind = timeout::NONE;
+  unsigned ms = 0;
+  if (conn->m_closing) {
+    // nothing to wait for
+  } else if (conn->m_pending_writes || (conn->m_stream && conn->m_stream->m_started && conn->m_stream->m_queued.load())) {
+    kind = timeout::WRITE;
+    ms = m_settings.m_write_timeout;
+  } else if (conn->m_deferred) {
+    // a deferred request, or the producer of a stream, may take as long as it needs
+  } else if (conn->m_req) {
+    kind = conn->m_parser.m_headers_complete ? timeout::BODY : timeout::HEADER;
+    ms = kind == timeout::BODY ? m_settings.m_body_timeout : m_settings.m_header_timeout;
+  } else if (conn->m_nrequests) {
+    kind = timeout::IDLE;
+    ms = m_settings.m_keep_alive_timeout;
+  } else {
+    kind = timeout::HEADER;
+    ms = m_settings.m_header_timeout;
+  }
+  if (!ms) kind = timeout::NONE;
+  // a head trickling in byte by byte doesn't push its deadline back (slowloris)
+  if (kind == conn->m_timer.m_kind && !(progress && (kind == timeout::BODY || kind == timeout::WRITE))) return;
+  if (kind == timeout::NONE) return m_timers.cancel(&conn->m_timer);
+  m_timers.schedule(&conn->m_timer, kind, (ms + FC_TIMER_TICK - 1) / FC_TIMER_TICK);
+  if (!uv_is_active((uv_handle_t *)&m_tick_timer)) uv_timer_start(&m_tick_timer, worker::on_timer_tick, FC_TIMER_TICK, FC_TIMER_TICK);
+}
+
+void worker::expire(connection *conn, timeout kind) {
+  bump(m_stats.m_timeouts[static_cast<size_t>(kind) - 1]);
+  if (conn->m_req && 0 == conn->m_pending_writes && !conn->m_deferred) {
+    // the client is told why its request goes unanswered, the connection closes once that is out
+    conn->m_keep_alive = false;
+    conn->m_route = 0;
+    conn->m_started = uv_hrtime();
+    conn->m_bytes_in = conn->m_inbuf_len;
+    conn->m_req.reset();
+    conn->m_arena.reset();
+    return send_error(conn, status::REQUEST_TIMEOUT);
+  }
+  close_connection(conn);
+}
+
+void worker::on_write_response(uv_write_t *req, int status) {
+  connection *conn = (connection *)req->handle;
+  worker *self = (worker *)req->handle->loop->data;
+  write_ctx *ctx = (write_ctx *)req->data;
+  if (ctx == conn->m_file_ctx) {
+    // the header block is out, the file follows
+    if (status < 0) return self->end_file(conn, status);
+    return self->send_file(conn);
+  }
+  self->finish_write(conn, ctx, status);
+}
+
+void worker::on_stream_write(uv_write_t *req, int status) {
+  connection *conn = (connection *)req->handle;
+  worker *self = (worker *)req->handle->loop->data;
+  stream_write *w = (stream_write *)req->data;
+  std::shared_ptr<body_stream::state> stream = std::move(w->m_stream);
+  size_t bytes = w->m_bytes;
+  bool last = w->m_last;
+  delete w;
+  stream->m_queued -= bytes;
+  if (status < 0) {
+    if (status != UV_ECANCELED)
+      std::cerr << "[FALCON ERROR]: Failed to write response, " << uv_strerror(status) << std::endl;
+    return self->close_connection(conn);
+  }
+  // the connection went away or moved on meanwhile
+  if (stream->m_conn != conn) return;
+  if (self->m_stats.m_routes && conn->m_route < self->m_stats.m_nroutes) bump(self->m_stats.m_routes[conn->m_route].m_bytes_out, bytes);
+  if (last) return self->end_stream(conn);
+  if (stream->m_queued.load() < FC_STREAM_LOW_WATER) self->pull_stream(stream);
+  self->arm_timeout(conn, true);
+}
+
+void worker::on_sendfile(uv_fs_t *fs) {
+  connection *conn = (connection *)fs->data;
+  worker *self = (worker *)fs->loop->data;
+  ssize_t result = fs->result;
+  uv_fs_req_cleanup(fs);
+  if (conn->m_closing) return self->end_file(conn, UV_ECANCELED);
+  if (UV_EAGAIN == result) {
+    // the socket send buffer is full, sendfile is tried again shortly for every connection waiting on it
+    self->m_sendfile_waiting.push_back(conn);
+    if (!uv_is_active((uv_handle_t *)&self->m_sendfile_timer)) {
+      uv_timer_start(&self->m_sendfile_timer, worker::on_sendfile_retry, FC_SENDFILE_RETRY_DELAY, 0);
+    }
+    return;
+  }
+  // the file shrank since it was opened, the response can't be completed
+  if (0 == result) result = UV_EPIPE;
+  if (result < 0) return self->end_file(conn, result);
+  auto &file = *conn->m_file_ctx->m_res.m_file;
+  file.m_offset += result;
+  file.m_length -= result;
+  if (file.m_length) {
+    self->arm_timeout(conn, true);
+    return self->send_file(conn);
+  }
+  self->end_file(conn, 0);
+}
+
+void worker::on_sendfile_retry(uv_timer_t *timer) {
+  worker *self = (worker *)timer->loop->data;
+  std::vector<connection *> waiting;
+  waiting.swap(self->m_sendfile_waiting);
+  for (connection *conn : waiting) {
+    if (conn->m_closing) {
+      self->end_file(conn, UV_ECANCELED);
+    } else {
+      self->send_file(conn);
+    }
+  }
+}
+
+void worker::on_completed_async(uv_async_t *async) {
+  worker *self = (worker *)async->loop->data;
+  std::vector<std::pair<connection *, response>> completed;
+  std::vector<std::shared_ptr<body_stream::state>> streams;
+  {
+    std::lock_guard<std::mutex> lock(self->m_completed_mutex);
+    completed.swap(self->m_completed);
+    streams.swap(self->m_streams);
+  }
+  for (auto &[conn, res] : completed) self->complete_deferred(conn, std::move(res));
+  for (auto &stream : streams) self->flush_stream(stream);
+}
+
+void worker::on_compress_work(uv_work_t *work) {
+  compress_ctx *ctx = (compress_ctx *)work->data;
+  compression::apply(ctx->m_res, ctx->m_coding, ctx->m_level);
+}
+
+void worker::on_compress_done(uv_work_t *work, int) {
+  compress_ctx *ctx = (compress_ctx *)work->data;
+  // whether zlib succeeded or not the response goes out as it is now
+  ctx->m_conn->m_coding = content_coding::IDENTITY;
+  ((worker *)work->loop->data)->complete_deferred(ctx->m_conn, std::move(ctx->m_res));
+  delete ctx;
+}
+
+void worker::on_timer_tick(uv_timer_t *timer) {
+  worker *self = (worker *)timer->loop->data;
+  self->m_timers.tick([self](timer_entry *entry, timeout kind) { self->expire((connection *)entry->m_data, kind); });
+  // an idle loop doesn't wake up for nothing
+  if (0 == self->m_timers.m_size) uv_timer_stop(timer);
+}
+
+void worker::on_close_conn(uv_handle_t *handle) {
+  connection *conn = (connection *)handle->data;
+  if (0 != --conn->m_open_handles) return;
+  // a sendfile still running on the thread pool, or a deferred response, frees it once done
+  if (conn->m_file_ctx || conn->m_deferred) return;
+  ((worker *)handle->loop->data)->free_connection(conn);
+}
+
+void worker::free_connection(connection *conn) {
+  bump(m_stats.m_closed);
+  // a request still deferred when the connection closed goes before the memory it points into
+  conn->m_req.reset();
+  release_input(conn);
+  delete conn;
+  m_nconnections--;
+  if (m_accept_paused) {
+    m_accept_paused = false;
+    accept_connection();
+  }
+}
+
+} // namespace fc
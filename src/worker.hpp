@@ -0,0 +1,158 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <uv.h>
+
+#include "canned.hpp"
+#include "codel.hpp"
+#include "compress.hpp"
+#include "conn.hpp"
+#include "http.hpp"
+#include "pool.hpp"
+#include "include/fc.hpp"
+#include "metrics.hpp"
+#include "router.hpp"
+#include "stream.hpp"
+#include "timer.hpp"
+
+#define FC_BACKLOG (128) // connections the kernel keeps waiting to be accepted
+#define FC_KEEP_ALIVE_TIMEOUT (5000) // 5 s
+#define FC_HEADER_TIMEOUT (10000)    // 10 s to send a whole request head
+#define FC_BODY_TIMEOUT (10000)      // 10 s at most between two reads of a request body
+#define FC_WRITE_TIMEOUT (30000)     // 30 s at most without a write completing
+#define FC_MAX_REQUESTS_PER_CONN (1000)
+#define FC_MAX_HEADER_SIZE (1024 * 16)     // 16 KB
+#define FC_MAX_BODY_SIZE (1024 * 1024 * 5) // 5 MB
+#define FC_MAX_JSON_DEPTH (64)             // nested arrays and objects accepted by 'request::json'
+#define FC_MIN_READ_SIZE (1024 * 4)        // grow the input buffer below this much free space
+#define FC_READ_SLAB_SIZE (1024 * 16)      // 16 KB
+#define FC_READ_POOL_MAX_FREE (256)        // slabs kept around per worker once released
+#define FC_SENDFILE_RETRY_DELAY (1)        // ms before a sendfile that found the socket full is tried again
+
+namespace fc {
+
+// Tunables shared by every worker, written through 'app' before 'listen' and read-only afterwards
+struct settings {
+  unsigned m_keep_alive_timeout = FC_KEEP_ALIVE_TIMEOUT;
+  unsigned m_header_timeout = FC_HEADER_TIMEOUT;
+  unsigned m_body_timeout = FC_BODY_TIMEOUT;
+  unsigned m_write_timeout = FC_WRITE_TIMEOUT;
+  unsigned m_max_requests_per_conn = FC_MAX_REQUESTS_PER_CONN;
+  size_t m_max_header_size = FC_MAX_HEADER_SIZE;
+  size_t m_max_body_size = FC_MAX_BODY_SIZE;
+  size_t m_max_json_size = 0; // 0 leaves only the body size limit
+  unsigned m_max_json_depth = FC_MAX_JSON_DEPTH;
+  unsigned m_offload_threads = 0; // 0 keeps the libuv default
+  int m_backlog = FC_BACKLOG;
+  // per worker, 0 for no limit
+  unsigned m_max_connections = 0;
+  unsigned m_max_in_flight = 0;
+  unsigned m_shed_target = 0; // ms, queue delay refused by 'codel', 0 disables adaptive shedding
+  bool m_metrics = false;          // per route counters and histograms, see 'app::expose_metrics'
+  int m_compression_level = 0;     // 0 disables compression
+  size_t m_compression_min_size = FC_COMPRESSION_MIN_SIZE;
+  size_t m_compression_offload_size = FC_COMPRESSION_OFFLOAD_SIZE;
+};
+
+// A worker owns one event loop and everything bound to it: the listening socket and the
+// connections it accepts, each with its own http parser. Workers never share mutable state,
+// the router and settings are only read once 'listen' was called.
+struct worker {
+public:
+  // The 'm_loop->data' field always holds a pointer to the worker running that loop
+  uv_loop_t *m_loop;
+  uv_tcp_t m_host_sock;
+  std::thread m_thread;
+  buffer_pool m_read_pool;
+  // connections whose sendfile hit a full socket buffer, retried together when the timer fires
+  uv_timer_t m_sendfile_timer;
+  std::vector<connection *> m_sendfile_waiting;
+  // every connection timeout, the timer only runs while the wheel holds some
+  uv_timer_t m_tick_timer;
+  timer_wheel m_timers;
+  // responses to deferred requests, posted from any thread and sent from the loop
+  uv_async_t m_completed_async;
+  std::mutex m_completed_mutex;
+  std::vector<std::pair<connection *, response>> m_completed;
+  // streams with chunks to flush, posted the same way
+  std::vector<std::shared_ptr<body_stream::state>> m_streams;
+  worker_stats m_stats;
+  // admission control, see 'should_shed'
+  size_t m_nconnections;
+  size_t m_in_flight; // connections with 'm_in_flight' set
+  bool m_accept_paused; // the listening socket is not polled until a connection goes away
+  codel m_codel;
+
+  const root_router &m_router;
+  const settings &m_settings;
+
+  worker(uv_loop_t *loop, const root_router &router, const settings &settings) : m_loop(loop), m_read_pool(FC_READ_SLAB_SIZE, FC_READ_POOL_MAX_FREE), m_nconnections(0), m_in_flight(0), m_accept_paused(false),
+        m_codel(uint64_t(settings.m_shed_target) * 1000000, uint64_t(FC_SHED_INTERVAL) * 1000000), m_router(router), m_settings(settings) {
+    m_loop->data = this;
+    m_stats.m_read_pool = &m_read_pool;
+    if (m_settings.m_metrics) m_stats.enable(m_router.m_route_names.size() + 1);
+    uv_timer_init(m_loop, &m_sendfile_timer);
+    uv_timer_init(m_loop, &m_tick_timer);
+    uv_async_init(m_loop, &m_completed_async, worker::on_completed_async);
+  }
+
+  int bind(const struct sockaddr *, bool reuse_port);
+  int run() { return uv_run(m_loop, UV_RUN_DEFAULT); }
+  // Closes every handle of the loop, connections included, and runs it until they are gone so it
+  // can be closed. Called from the thread running the loop, or from any once it stopped.
+  void close();
+
+  void accept_connection();
+  // whether a request is refused with 503 rather than dispatched, the loop being overloaded
+  bool should_shed(connection *);
+  void reserve_input(connection *);
+  void release_input(connection *);
+  void parse_http_request(connection *);
+  void match_request_to_handler(connection *, request &);
+  void end_request(connection *);
+  void send_handler_response(connection *, response);
+  bool compress_response(connection *, response &);
+  void post_deferred(connection *, response);
+  void complete_deferred(connection *, response);
+  void start_stream(connection *, response);
+  void post_stream(std::shared_ptr<body_stream::state>);
+  void pull_stream(const std::shared_ptr<body_stream::state> &);
+  void flush_stream(const std::shared_ptr<body_stream::state> &);
+  void end_stream(connection *);
+  void send_response(connection *, response);
+  // canned message for 'status' when there is one, 'response::ok(status)' otherwise
+  void send_error(connection *, status);
+  void send_canned(connection *, status, std::string_view message);
+  void schedule_write(connection *, write_ctx *);
+  void write_response(connection *, write_ctx *);
+  void finish_write(connection *, write_ctx *, int status);
+  void send_file(connection *);
+  void end_file(connection *, int status);
+  void close_connection(connection *);
+  void free_connection(connection *);
+  // Times the connection for what it waits on, 'progress' restarts the body and write timeouts
+  // which bound the time between two reads or writes rather than the whole transfer
+  void arm_timeout(connection *, bool progress = false);
+  void expire(connection *, timeout);
+
+  // uv callbacks
+  static void on_connection(uv_stream_t *server, int status);
+  static void on_alloc_buf(uv_handle_t *client, size_t size, uv_buf_t *buf);
+  static void on_read_buf(uv_stream_t *client, long nread, const uv_buf_t *buf);
+  static void on_write_response(uv_write_t *req, int status);
+  static void on_stream_write(uv_write_t *req, int status);
+  static void on_sendfile(uv_fs_t *req);
+  static void on_sendfile_retry(uv_timer_t *timer);
+  static void on_completed_async(uv_async_t *async);
+  static void on_compress_work(uv_work_t *work);
+  static void on_compress_done(uv_work_t *work, int status);
+  static void on_timer_tick(uv_timer_t *timer);
+  static void on_close_conn(uv_handle_t *client);
+};
+
+} // namespace fc
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string_view>
+
+#include <unity.h>
+
+#include "include/fc.hpp"
+#include "src/arena.hpp"
+#include "src/http.hpp"
+#include "src/pool.hpp"
+#include "src/req.hpp"
+
+// Parsing state of the tests working on raw requests, each test executable gets its own. Requests
+// borrow from 'arena', tests reset it in 'tearDown' or once done with a request.
+static fc::buffer_pool pool(1024 * 16, 4);
+static fc::arena arena(&pool);
+static fc::http_parser parser(1024 * 16, 1024 * 1024);
+
+// request parsed from 'raw', a whole message that has to outlive it
+inline fc::request parse_request(std::string_view raw)
+{
+  fc::request req = fc::request_factory(nullptr, {}, &arena);
+  size_t nparsed = 0;
+  TEST_ASSERT_EQUAL_INT(HPE_PAUSED, parser.execute(&req, raw.data(), raw.size(), &nparsed));
+  TEST_ASSERT_EQUAL(raw.size(), nparsed);
+  return req;
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <cctype>
+#include <chrono>
+#include <memory>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+#include <uv.h>
+
+#include <unity.h>
+
+#include "external/llhttp/llhttp.h"
+#include "include/fc.hpp"
+#include "src/router.hpp"
+#include "src/worker.hpp"
+
+// A worker serving 'router' on an ephemeral port of 127.0.0.1 from its own thread, for the tests
+// talking to it through real sockets. Routes and settings are fixed once it runs.
+struct test_server {
+public:
+  fc::root_router m_router;
+  fc::settings m_settings;
+  uv_loop_t m_loop;
+  uv_async_t m_stop;
+  std::unique_ptr<fc::worker> m_worker;
+  std::thread m_thread;
+  int m_port = 0;
+
+  test_server() = default;
+  test_server(const test_server &) = delete;
+  ~test_server() { stop(); }
+
+  void start()
+  {
+    uv_loop_init(&m_loop);
+    m_worker = std::make_unique<fc::worker>(&m_loop, m_router, m_settings);
+    struct sockaddr_in addr;
+    uv_ip4_addr("127.0.0.1", 0, &addr);
+    TEST_ASSERT_EQUAL_INT(0, m_worker->bind((const struct sockaddr *)&addr, false));
+    int len = sizeof(addr);
+    uv_tcp_getsockname(&m_worker->m_host_sock, (struct sockaddr *)&addr, &len);
+    m_port = ntohs(addr.sin_port);
+    // 'm_loop.data' belongs to the worker, the async one carries nothing
+    uv_async_init(&m_loop, &m_stop, [](uv_async_t *async) { uv_stop(async->loop); });
+    m_thread = std::thread([this] {
+      m_worker->run();
+      m_worker->close();
+    });
+  }
+
+  void stop()
+  {
+    if (!m_thread.joinable()) return;
+    uv_async_send(&m_stop);
+    m_thread.join();
+    uv_loop_close(&m_loop);
+  }
+};
+
+// polls 'done' for up to 5 s, for what the loop thread changes behind the test's back
+template <typename F> bool eventually(F done)
+{
+  for (int i = 0; i < 5000; i++) {
+    if (done()) return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return done();
+}
+
+struct test_response {
+  int m_status = 0;
+  std::string m_head; // 'name: value' lines, names lowercased
+  std::string m_body; // decoded when chunked
+  bool m_chunked = false;
+};
+
+// Blocking client reading responses with llhttp, a read that takes more than 5 s fails the test
+struct test_client {
+public:
+  int m_fd;
+  llhttp_t m_parser;
+  llhttp_settings_t m_callbacks;
+  test_response m_res;
+  std::string m_field;
+  std::string m_pending; // bytes read past the last response
+
+  explicit test_client(int port)
+  {
+    m_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct timeval timeout = {5, 0};
+    setsockopt(m_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    TEST_ASSERT_EQUAL_INT(0, ::connect(m_fd, (struct sockaddr *)&addr, sizeof(addr)));
+    llhttp_settings_init(&m_callbacks);
+    m_callbacks.on_status_complete = [](llhttp_t *p) {
+      ((test_client *)p->data)->m_res.m_status = p->status_code;
+      return 0;
+    };
+    m_callbacks.on_header_field = [](llhttp_t *p, const char *at, size_t len) {
+      test_client *self = (test_client *)p->data;
+      for (size_t i = 0; i < len; i++) self->m_field.push_back(std::tolower((unsigned char)at[i]));
+      return 0;
+    };
+    m_callbacks.on_header_field_complete = [](llhttp_t *p) {
+      test_client *self = (test_client *)p->data;
+      self->m_res.m_head.append(self->m_field).append(": ");
+      self->m_field.clear();
+      return 0;
+    };
+    m_callbacks.on_header_value = [](llhttp_t *p, const char *at, size_t len) {
+      ((test_client *)p->data)->m_res.m_head.append(at, len);
+      return 0;
+    };
+    m_callbacks.on_header_value_complete = [](llhttp_t *p) {
+      ((test_client *)p->data)->m_res.m_head.append("\r\n");
+      return 0;
+    };
+    m_callbacks.on_body = [](llhttp_t *p, const char *at, size_t len) {
+      ((test_client *)p->data)->m_res.m_body.append(at, len);
+      return 0;
+    };
+    m_callbacks.on_headers_complete = [](llhttp_t *p) {
+      ((test_client *)p->data)->m_res.m_chunked = p->flags & F_CHUNKED;
+      return 0;
+    };
+    // one response at a time, the bytes after it are kept for the next call
+    m_callbacks.on_message_complete = [](llhttp_t *) { return (int)HPE_PAUSED; };
+    llhttp_init(&m_parser, HTTP_RESPONSE, &m_callbacks);
+    m_parser.data = this;
+  }
+  test_client(const test_client &) = delete;
+  ~test_client() { close(); }
+
+  void send(const std::string &raw) { TEST_ASSERT_EQUAL((ssize_t)raw.size(), ::send(m_fd, raw.data(), raw.size(), MSG_NOSIGNAL)); }
+
+  // next response on the connection, a 0 status when it was closed before one came whole
+  test_response read()
+  {
+    m_res = {};
+    std::string data;
+    data.swap(m_pending);
+    for (;;) {
+      if (!data.empty()) {
+        llhttp_errno err = llhttp_execute(&m_parser, data.data(), data.size());
+        if (HPE_PAUSED == err) {
+          m_pending = data.substr(llhttp_get_error_pos(&m_parser) - data.data());
+          llhttp_resume(&m_parser);
+          return m_res;
+        }
+        TEST_ASSERT_EQUAL_INT(HPE_OK, err);
+      }
+      char buf[4096];
+      ssize_t n = ::recv(m_fd, buf, sizeof(buf), 0);
+      TEST_ASSERT_TRUE_MESSAGE(n >= 0, "no response within 5 s");
+      if (0 == n) {
+        // a body delimited by the end of the connection
+        if (HPE_OK == llhttp_finish(&m_parser) && m_res.m_status) return m_res;
+        return {};
+      }
+      data.assign(buf, n);
+    }
+  }
+
+  // every byte up to the server closing the connection, unparsed
+  std::string read_raw()
+  {
+    std::string data;
+    data.swap(m_pending);
+    char buf[4096];
+    ssize_t n;
+    while ((n = ::recv(m_fd, buf, sizeof(buf), 0)) > 0) data.append(buf, n);
+    TEST_ASSERT_EQUAL_MESSAGE(0, n, "connection not closed within 5 s");
+    return data;
+  }
+
+  // whether the server closed the connection, with nothing more to read
+  bool closed()
+  {
+    if (!m_pending.empty()) return false;
+    char c;
+    return 0 == ::recv(m_fd, &c, 1, 0);
+  }
+
+  void close()
+  {
+    if (m_fd >= 0) ::close(m_fd);
+    m_fd = -1;
+  }
+};
@@ -0,0 +1,222 @@
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <unity.h>
+
+#include "server.hpp"
+
+// stopped in 'tearDown', a failed assertion leaves the test function without unwinding it
+static std::unique_ptr<test_server> server;
+
+// responder of the request deferred by 'park', answered by the test thread
+static std::mutex parked_mutex;
+static std::optional<fc::responder> parked;
+
+static fc::response park(fc::request &req)
+{
+  std::lock_guard<std::mutex> lock(parked_mutex);
+  parked.emplace(req.defer());
+  return fc::response::pending();
+}
+
+// the request outlives its handler until the deferred response is sent, body included
+static std::string_view parked_body;
+
+static fc::response park_body(fc::request &req)
+{
+  std::lock_guard<std::mutex> lock(parked_mutex);
+  parked_body = req.get_body();
+  parked.emplace(req.defer());
+  return fc::response::pending();
+}
+
+static fc::response drop(fc::request &req)
+{
+  req.defer();
+  return fc::response::pending();
+}
+
+static fc::response echo(fc::request &req) { return fc::response::json(req.get_param("name").value()); }
+
+static fc::response offload_forbidden(fc::request &req)
+{
+  return fc::app::offload(req, []() -> fc::response { throw fc::http_error(fc::status::FORBIDDEN); });
+}
+
+static fc::response offload_failing(fc::request &req)
+{
+  return fc::app::offload(req, []() -> fc::response { throw std::runtime_error("no database"); });
+}
+
+static fc::response offload_thrown_int(fc::request &req)
+{
+  return fc::app::offload(req, []() -> fc::response { throw 42; });
+}
+
+static fc::response offload_ok(fc::request &req)
+{
+  return fc::app::offload(req, [] { return fc::response::json("done"); });
+}
+
+// a body the client leaves unread fills the socket buffers, the write stays pending
+static fc::response huge(fc::request &)
+{
+  fc::response res = fc::response::ok();
+  res.append_body(std::string(64 * 1024 * 1024, 'x'));
+  return res;
+}
+
+static void start(unsigned write_timeout = FC_WRITE_TIMEOUT)
+{
+  server = std::make_unique<test_server>();
+  server->m_settings.m_write_timeout = write_timeout;
+  server->m_router.add(fc::method::GET, "/park", park, {});
+  server->m_router.add(fc::method::POST, "/park", park_body, {});
+  server->m_router.add(fc::method::GET, "/drop", drop, {});
+  server->m_router.add(fc::method::GET, "/echo/:name", echo, {});
+  server->m_router.add(fc::method::GET, "/offload/forbidden", offload_forbidden, {});
+  server->m_router.add(fc::method::GET, "/offload/failing", offload_failing, {});
+  server->m_router.add(fc::method::GET, "/offload/thrown", offload_thrown_int, {});
+  server->m_router.add(fc::method::GET, "/offload/ok", offload_ok, {});
+  server->m_router.add(fc::method::GET, "/huge", huge, {});
+  server->start();
+}
+
+// the responder parked by the loop thread, once it is
+static fc::responder take_parked()
+{
+  TEST_ASSERT_TRUE(eventually([] {
+    std::lock_guard<std::mutex> lock(parked_mutex);
+    return parked.has_value();
+  }));
+  std::lock_guard<std::mutex> lock(parked_mutex);
+  fc::responder responder = *parked;
+  parked.reset();
+  return responder;
+}
+
+void setUp(void)
+{
+  // set stuff up here
+}
+
+void tearDown(void)
+{
+  // a responder posts to its worker when the last copy goes, that must happen first
+  parked.reset();
+  server.reset();
+}
+
+void test_dropped_responder_answers_500()
+{
+  start();
+  test_client client(server->m_port);
+  client.send("GET /drop HTTP/1.1\r\nHost: x\r\n\r\nGET /echo/a HTTP/1.1\r\nHost: x\r\n\r\n");
+  TEST_ASSERT_EQUAL(500, client.read().m_status);
+  // the connection goes on with the request behind it
+  TEST_ASSERT_EQUAL_STRING("\"a\"", client.read().m_body.c_str());
+}
+
+void test_only_the_first_send_counts()
+{
+  start();
+  test_client client(server->m_port);
+  client.send("GET /park HTTP/1.1\r\nHost: x\r\n\r\nGET /echo/a HTTP/1.1\r\nHost: x\r\n\r\n");
+  fc::responder responder = take_parked();
+  fc::responder copy = responder;
+  copy.send(fc::response::json("first"));
+  responder.send(fc::response::json("second"));
+  copy.send(fc::response::ok(fc::status::FORBIDDEN));
+  TEST_ASSERT_EQUAL_STRING("\"first\"", client.read().m_body.c_str());
+  // the pipelined request waited for the deferred one and nothing else was written in between
+  TEST_ASSERT_EQUAL_STRING("\"a\"", client.read().m_body.c_str());
+  client.send("GET /echo/b HTTP/1.1\r\nHost: x\r\n\r\n");
+  TEST_ASSERT_EQUAL_STRING("\"b\"", client.read().m_body.c_str());
+}
+
+void test_offloaded_errors_become_responses()
+{
+  start();
+  test_client client(server->m_port);
+  client.send("GET /offload/forbidden HTTP/1.1\r\nHost: x\r\n\r\n");
+  TEST_ASSERT_EQUAL(403, client.read().m_status);
+  client.send("GET /offload/failing HTTP/1.1\r\nHost: x\r\n\r\n");
+  TEST_ASSERT_EQUAL(500, client.read().m_status);
+  client.send("GET /offload/thrown HTTP/1.1\r\nHost: x\r\n\r\n");
+  TEST_ASSERT_EQUAL(500, client.read().m_status);
+  client.send("GET /offload/ok HTTP/1.1\r\nHost: x\r\n\r\n");
+  TEST_ASSERT_EQUAL_STRING("\"done\"", client.read().m_body.c_str());
+}
+
+void test_deferred_request_keeps_its_body()
+{
+  start();
+  test_client client(server->m_port);
+  // a chunked body is joined in a buffer of the request
+  client.send("POST /park HTTP/1.1\r\nHost: x\r\nTransfer-Encoding: chunked\r\n\r\n"
+              "5\r\nhello\r\n7\r\n, world\r\n0\r\n\r\n"
+              "GET /echo/a HTTP/1.1\r\nHost: x\r\n\r\n");
+  take_parked().send(fc::response::json(std::string(parked_body)));
+  TEST_ASSERT_EQUAL_STRING("\"hello, world\"", client.read().m_body.c_str());
+  TEST_ASSERT_EQUAL_STRING("\"a\"", client.read().m_body.c_str());
+  // one spanning several read buffers
+  std::string body(256 * 1024, 'x');
+  client.send("POST /park HTTP/1.1\r\nHost: x\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body);
+  fc::responder responder = take_parked();
+  TEST_ASSERT_TRUE(parked_body == body);
+  responder.send(fc::response::ok());
+  TEST_ASSERT_EQUAL(200, client.read().m_status);
+}
+
+void test_client_gone_before_the_response()
+{
+  start();
+  {
+    test_client client(server->m_port);
+    client.send("GET /park HTTP/1.1\r\nHost: x\r\n\r\n");
+    take_parked().send(fc::response::json("late"));
+  }
+  test_client client(server->m_port);
+  client.send("GET /park HTTP/1.1\r\nHost: x\r\n\r\n");
+  fc::responder responder = take_parked();
+  client.close();
+  // reads are stopped while deferred, the close is found out once the response is written
+  responder.send(fc::response::json("late"));
+  fc::worker_stats &stats = server->m_worker->m_stats;
+  TEST_ASSERT_TRUE(eventually([&] { return 2 == stats.m_closed.load(); }));
+}
+
+void test_connection_closed_while_deferred()
+{
+  start(200);
+  test_client client(server->m_port);
+  // the first response is never read, the connection times out on its write with the second
+  // request still deferred: it is closed, and only freed once the response comes in
+  client.send("GET /huge HTTP/1.1\r\nHost: x\r\n\r\nGET /park HTTP/1.1\r\nHost: x\r\n\r\n");
+  fc::responder responder = take_parked();
+  fc::worker_stats &stats = server->m_worker->m_stats;
+  TEST_ASSERT_TRUE(eventually([&] { return 1 == stats.m_timeouts[static_cast<size_t>(fc::timeout::WRITE) - 1].load(); }));
+  TEST_ASSERT_EQUAL(0, stats.m_closed.load());
+  responder.send(fc::response::json("late"));
+  TEST_ASSERT_TRUE(eventually([&] { return 1 == stats.m_closed.load(); }));
+  // the loop carries on
+  test_client other(server->m_port);
+  other.send("GET /echo/a HTTP/1.1\r\nHost: x\r\n\r\n");
+  TEST_ASSERT_EQUAL_STRING("\"a\"", other.read().m_body.c_str());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_dropped_responder_answers_500);
+  RUN_TEST(test_only_the_first_send_counts);
+  RUN_TEST(test_offloaded_errors_become_responses);
+  RUN_TEST(test_deferred_request_keeps_its_body);
+  RUN_TEST(test_client_gone_before_the_response);
+  RUN_TEST(test_connection_closed_while_deferred);
+  return UNITY_END();
+}
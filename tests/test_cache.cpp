@@ -0,0 +1,110 @@
+#include <string>
+
+#include <unity.h>
+
+#include "fixture.hpp"
+#include "include/fc.hpp"
+#include "src/cache.hpp"
+#include "src/router.hpp"
+
+static std::string raw;
+static int calls = 0;
+
+static fc::response users(fc::request &req)
+{
+  calls++;
+  fc::response res = fc::response::json({{"call", calls}, {"lang", req.get_header("Accept-Language").value_or("")}});
+  res.set_header("X-Call", std::to_string(calls));
+  return res;
+}
+
+static fc::response private_user(fc::request &)
+{
+  calls++;
+  fc::response res = fc::response::ok();
+  res.set_header("Cache-Control", "private, max-age=60");
+  return res;
+}
+
+// serialized response to 'path', going through 'router'
+static std::string get(const fc::root_router &router, const std::string &path, const std::string &lang = "en")
+{
+  raw = "GET " + path + " HTTP/1.1\r\nHost: x\r\nAccept-Language: " + lang + "\r\n\r\n";
+  fc::request req = parse_request(raw);
+  TEST_ASSERT_TRUE(router.match(req));
+  std::string out = req.next().to_string();
+  arena.reset();
+  return out;
+}
+
+void setUp(void)
+{
+  calls = 0;
+}
+
+void tearDown(void)
+{
+  arena.reset();
+}
+
+void test_hits_skip_the_handler()
+{
+  fc::response_cache cache(60000, 1024 * 1024, {"Accept-Language"});
+  fc::root_router router;
+  router.add(fc::method::GET, "/users", users, {cache});
+
+  std::string first = get(router, "/users");
+  TEST_ASSERT_TRUE(first == get(router, "/users"));
+  // the same path once normalized
+  TEST_ASSERT_TRUE(first == get(router, "//users/"));
+  TEST_ASSERT_EQUAL(1, calls);
+  TEST_ASSERT_EQUAL(2, cache.hits());
+  TEST_ASSERT_EQUAL(1, cache.misses());
+
+  // another query string, or another value of a vary header, is another response
+  TEST_ASSERT_TRUE(get(router, "/users?page=2").find("X-Call: 2\r\n") != std::string::npos);
+  TEST_ASSERT_TRUE(get(router, "/users", "fr").find("\"lang\":\"fr\"") != std::string::npos);
+  TEST_ASSERT_EQUAL(3, calls);
+
+  TEST_ASSERT_EQUAL(3, cache.invalidate("/users"));
+  TEST_ASSERT_TRUE(get(router, "/users").find("X-Call: 4\r\n") != std::string::npos);
+}
+
+void test_expired_and_private_responses()
+{
+  fc::response_cache expiring(0);
+  fc::response_cache cache(60000);
+  fc::root_router router;
+  router.add(fc::method::GET, "/users", users, {expiring});
+  router.add(fc::method::GET, "/me", private_user, {cache});
+  get(router, "/users");
+  get(router, "/users");
+  TEST_ASSERT_EQUAL(2, calls);
+  get(router, "/me");
+  get(router, "/me");
+  TEST_ASSERT_EQUAL(4, calls);
+  TEST_ASSERT_EQUAL(0, cache.hits());
+}
+
+void test_least_recently_used_are_evicted()
+{
+  // a few hundred bytes per shard
+  fc::response_cache cache(60000, FC_CACHE_SHARDS * 1024);
+  fc::root_router router;
+  router.add(fc::method::GET, "/users/:id", users, {cache});
+  for (int i = 0; i < 200; i++) get(router, "/users/" + std::to_string(i));
+  TEST_ASSERT_TRUE(cache.evictions() > 0);
+
+  std::string out;
+  fc::render_cache_metrics(out);
+  TEST_ASSERT_TRUE(out.find("falcon_cache_evictions_total{cache=\"default\"} " + std::to_string(cache.evictions()) + "\n") != std::string::npos);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_hits_skip_the_handler);
+  RUN_TEST(test_expired_and_private_responses);
+  RUN_TEST(test_least_recently_used_are_evicted);
+  return UNITY_END();
+}
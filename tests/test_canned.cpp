@@ -0,0 +1,64 @@
+#include <cstring>
+#include <string>
+
+#include <unity.h>
+
+#include "fixture.hpp"
+#include "include/fc.hpp"
+#include "src/canned.hpp"
+#include "src/router.hpp"
+
+static fc::response noop(fc::request &) { return fc::response::ok(); }
+
+void setUp(void)
+{
+  // set stuff up here
+}
+
+void tearDown(void)
+{
+  arena.reset();
+}
+
+void test_canned_messages_match_regular_responses()
+{
+  std::string expected = fc::response::ok(fc::status::NOT_FOUND).to_string();
+  TEST_ASSERT_TRUE(expected == fc::canned_response(fc::status::NOT_FOUND, fc::conn_header::NONE));
+
+  std::string closing(fc::canned_response(fc::status::PAYLOAD_TOO_LARGE, fc::conn_header::CLOSE));
+  TEST_ASSERT_TRUE(closing.starts_with("HTTP/1.1 413 Payload Too Large\r\n"));
+  TEST_ASSERT_TRUE(closing.find("Connection: close\r\n\r\nPayload Too Large") != std::string::npos);
+
+  // the same bytes every time, nothing is formatted per request
+  TEST_ASSERT_TRUE(fc::canned_response(fc::status::BAD_REQUEST, fc::conn_header::NONE).data() == fc::canned_response(fc::status::BAD_REQUEST, fc::conn_header::NONE).data());
+  TEST_ASSERT_TRUE(fc::canned_response(fc::status::IM_A_TEAPOT, fc::conn_header::NONE).empty());
+
+  // refusals under overload tell the client when to come back
+  std::string unavailable(fc::canned_response(fc::status::SERVICE_UNAVAILABLE, fc::conn_header::NONE));
+  TEST_ASSERT_TRUE(unavailable.find("\r\nRetry-After: 1\r\n") != std::string::npos);
+}
+
+void test_not_allowed_lists_the_methods_of_the_path()
+{
+  fc::root_router router;
+  router.add(fc::method::GET, "/users/:id", noop, {});
+  router.add(fc::method::DELETE, "/users/:id", noop, {});
+
+  const char RAW[] = "POST /users/42 HTTP/1.1\r\nHost: x\r\nContent-Length: 0\r\n\r\n";
+  fc::request req = parse_request(RAW);
+  unsigned allowed = 0;
+  TEST_ASSERT_FALSE(router.match(req, &allowed));
+  TEST_ASSERT_EQUAL(1u << static_cast<int>(fc::method::GET) | 1u << static_cast<int>(fc::method::DELETE), allowed);
+
+  std::string message(fc::canned_not_allowed(allowed, fc::conn_header::KEEP_ALIVE));
+  TEST_ASSERT_TRUE(message.starts_with("HTTP/1.1 405 Method Not Allowed\r\n"));
+  TEST_ASSERT_TRUE(message.find("Allow: GET, DELETE\r\nConnection: keep-alive\r\n\r\n") != std::string::npos);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_canned_messages_match_regular_responses);
+  RUN_TEST(test_not_allowed_lists_the_methods_of_the_path);
+  return UNITY_END();
+}
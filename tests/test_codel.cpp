@@ -0,0 +1,90 @@
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <unity.h>
+
+#include "server.hpp"
+#include "src/codel.hpp"
+
+static const uint64_t MS = 1000000;
+
+// stopped in 'tearDown', a failed assertion leaves the test function without unwinding it
+static std::unique_ptr<test_server> server;
+
+void setUp(void)
+{
+  // set stuff up here
+}
+
+void tearDown(void)
+{
+  server.reset();
+}
+
+void test_bursts_are_not_shed()
+{
+  fc::codel codel(5 * MS, 100 * MS);
+  uint64_t now = 0;
+  // long waits, but some request goes through quickly in every interval
+  for (int i = 0; i < 50; i++, now += 10 * MS) {
+    TEST_ASSERT_FALSE(codel.shed(i % 5 ? 50 * MS : 1 * MS, now));
+  }
+}
+
+void test_standing_queue_is_shed()
+{
+  fc::codel codel(5 * MS, 100 * MS);
+  uint64_t now = 0;
+  // a whole interval where nothing waits less than the target
+  for (; now < 100 * MS; now += 10 * MS) TEST_ASSERT_FALSE(codel.shed(20 * MS, now));
+  TEST_ASSERT_TRUE(codel.shed(20 * MS, now));
+  TEST_ASSERT_TRUE(codel.m_overloaded);
+  // below twice the target requests still go through
+  TEST_ASSERT_FALSE(codel.shed(8 * MS, now));
+
+  // the queue drained, the next interval clears the overload
+  for (now += 10 * MS; now < 250 * MS; now += 10 * MS) codel.shed(1 * MS, now);
+  TEST_ASSERT_FALSE(codel.m_overloaded);
+  TEST_ASSERT_FALSE(codel.shed(20 * MS, now));
+}
+
+// handler holding the loop, the requests read with it wait meanwhile
+static fc::response slow(fc::request &)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  return fc::response::ok();
+}
+
+void test_slow_handler_sheds_through_the_loop()
+{
+  server = std::make_unique<test_server>();
+  server->m_settings.m_shed_target = 5;
+  server->m_router.add(fc::method::GET, "/slow", slow, {});
+  server->start();
+  std::vector<std::unique_ptr<test_client>> clients;
+  for (int i = 0; i < 16; i++) clients.push_back(std::make_unique<test_client>(server->m_port));
+  // read in one or two polls, every request waits on those dispatched before it
+  for (auto &client : clients) client->send("GET /slow HTTP/1.1\r\nHost: x\r\n\r\n");
+  int ok = 0, refused = 0;
+  for (auto &client : clients) {
+    int status = client->read().m_status;
+    if (200 == status) ok++;
+    if (503 == status) refused++;
+  }
+  TEST_ASSERT_EQUAL(16, ok + refused);
+  // the first interval is never judged overloaded, then the standing queue is cut
+  TEST_ASSERT_TRUE(ok > 0);
+  TEST_ASSERT_TRUE(refused > 0);
+  TEST_ASSERT_EQUAL(refused, server->m_worker->m_stats.m_shed.load());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_bursts_are_not_shed);
+  RUN_TEST(test_standing_queue_is_shed);
+  RUN_TEST(test_slow_handler_sheds_through_the_loop);
+  return UNITY_END();
+}
@@ -0,0 +1,164 @@
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <zlib.h>
+
+#include <unity.h>
+
+#include "include/fc.hpp"
+#include "src/compress.hpp"
+
+using fc::content_coding;
+
+// body of a serialized response, inflated with 'window_bits' (31 for gzip, 15 for zlib)
+static std::string inflate_body(const std::string &raw, int window_bits)
+{
+  std::string body = raw.substr(raw.find("\r\n\r\n") + 4);
+  z_stream zs{};
+  TEST_ASSERT_EQUAL_INT(Z_OK, inflateInit2(&zs, window_bits));
+  std::string out(1024 * 1024, '\0');
+  zs.next_in = (Bytef *)body.data();
+  zs.avail_in = body.size();
+  zs.next_out = (Bytef *)out.data();
+  zs.avail_out = out.size();
+  TEST_ASSERT_EQUAL_INT(Z_STREAM_END, inflate(&zs, Z_FINISH));
+  out.resize(zs.total_out);
+  inflateEnd(&zs);
+  return out;
+}
+
+static std::string text(size_t size)
+{
+  std::string s;
+  while (s.size() < size) s += "{\"id\": " + std::to_string(s.size()) + ", \"name\": \"falcon\"},";
+  return s.substr(0, size);
+}
+
+// "OK" followed by nothing else yet
+static fc::response ok_with_type(const std::string &type)
+{
+  fc::response res = fc::response::ok();
+  res.set_content_type(type);
+  return res;
+}
+
+void setUp(void)
+{
+  // set stuff up here
+}
+
+void tearDown(void)
+{
+  // clean stuff up here
+}
+
+void test_negotiation_follows_q_values()
+{
+  TEST_ASSERT_TRUE(content_coding::GZIP == fc::negotiate_coding("gzip, deflate, br"));
+  TEST_ASSERT_TRUE(content_coding::GZIP == fc::negotiate_coding("deflate, GZIP"));
+  TEST_ASSERT_TRUE(content_coding::DEFLATE == fc::negotiate_coding("gzip;q=0.5, deflate"));
+  TEST_ASSERT_TRUE(content_coding::DEFLATE == fc::negotiate_coding("gzip;q=0, *"));
+  TEST_ASSERT_TRUE(content_coding::GZIP == fc::negotiate_coding("*"));
+  TEST_ASSERT_TRUE(content_coding::IDENTITY == fc::negotiate_coding("br, identity"));
+  TEST_ASSERT_TRUE(content_coding::IDENTITY == fc::negotiate_coding("*;q=0"));
+  TEST_ASSERT_TRUE(content_coding::IDENTITY == fc::negotiate_coding(""));
+}
+
+void test_only_large_textual_bodies_are_eligible()
+{
+  fc::response small = fc::response::json({{"id", 1}});
+  TEST_ASSERT_FALSE(fc::compression::eligible(small, 1024));
+  TEST_ASSERT_TRUE(fc::compression::eligible(small, 1));
+
+  fc::response binary = ok_with_type("image/png");
+  binary.append_body(text(4096));
+  TEST_ASSERT_FALSE(fc::compression::eligible(binary, 1024));
+
+  fc::response html = ok_with_type("text/html; charset=utf-8");
+  html.append_body(text(4096));
+  TEST_ASSERT_TRUE(fc::compression::eligible(html, 1024));
+  html.set_header("content-encoding", "br");
+  TEST_ASSERT_FALSE(fc::compression::eligible(html, 1024));
+
+  fc::response empty = fc::response::ok(fc::status::NO_CONTENT);
+  TEST_ASSERT_FALSE(fc::compression::eligible(empty, 0));
+}
+
+void test_segments_compress_into_one_stream()
+{
+  std::string expected = "OK" + text(50000);
+  for (auto [coding, bits, name] : {std::tuple{content_coding::GZIP, 31, "gzip"}, std::tuple{content_coding::DEFLATE, 15, "deflate"}}) {
+    fc::response res = ok_with_type("application/json");
+    res.append_body(expected.substr(2, 9998));
+    res.append_body(std::make_shared<const std::string>(expected.substr(10000, 30000)));
+    res.append_static_body(std::string_view(expected).substr(40000));
+    TEST_ASSERT_TRUE(fc::compression::apply(res, coding, 6));
+    TEST_ASSERT_TRUE(res.content_length() < expected.size() / 4);
+
+    std::string raw = res.to_string();
+    TEST_ASSERT_TRUE(raw.find(std::string("Content-Encoding: ") + name + "\r\n") != std::string::npos);
+    TEST_ASSERT_TRUE(raw.find("Vary: Accept-Encoding\r\n") != std::string::npos);
+    TEST_ASSERT_TRUE(raw.find("Content-Length: " + std::to_string(res.content_length()) + "\r\n") != std::string::npos);
+    TEST_ASSERT_TRUE(expected == inflate_body(raw, bits));
+  }
+}
+
+void test_vary_is_not_repeated()
+{
+  fc::response res = ok_with_type("text/css");
+  res.set_header("Vary", "Accept-Encoding");
+  res.append_body(text(2048));
+  TEST_ASSERT_TRUE(fc::compression::apply(res, content_coding::GZIP, 1));
+  std::string raw = res.to_string();
+  TEST_ASSERT_EQUAL(raw.find("Vary:"), raw.rfind("Vary:"));
+}
+
+void test_vary_keeps_what_was_there()
+{
+  fc::response res = ok_with_type("text/css");
+  res.set_header("Vary", "Cookie");
+  res.append_body(text(2048));
+  TEST_ASSERT_TRUE(fc::compression::apply(res, content_coding::GZIP, 1));
+  TEST_ASSERT_TRUE(res.to_string().find("Vary: Cookie, Accept-Encoding\r\n") != std::string::npos);
+  // identity responses of the same resource say the same
+  fc::response identity = ok_with_type("text/css");
+  identity.set_header("Vary", "Cookie");
+  fc::compression::add_vary(identity);
+  TEST_ASSERT_TRUE(identity.to_string().find("Vary: Cookie, Accept-Encoding\r\n") != std::string::npos);
+  // listed already, in any case, or everything
+  for (const char *value : {"cookie, accept-encoding", "*"}) {
+    fc::response listed = ok_with_type("text/css");
+    listed.set_header("Vary", value);
+    fc::compression::add_vary(listed);
+    TEST_ASSERT_TRUE(listed.to_string().find(std::string("Vary: ") + value + "\r\n") != std::string::npos);
+    TEST_ASSERT_TRUE(listed.to_string().find(std::string("Vary: ") + value + ", ") == std::string::npos);
+  }
+}
+
+void test_compressed_body_gets_a_weak_etag()
+{
+  fc::response res = ok_with_type("text/css");
+  res.set_header("ETag", "\"5f1c-2000\"");
+  res.append_body(text(2048));
+  TEST_ASSERT_TRUE(fc::compression::apply(res, content_coding::GZIP, 1));
+  TEST_ASSERT_TRUE(res.to_string().find("ETag: W/\"5f1c-2000\"\r\n") != std::string::npos);
+  // weak already
+  fc::response weak = ok_with_type("text/css");
+  weak.set_header("ETag", "W/\"5f1c-2000\"");
+  weak.append_body(text(2048));
+  TEST_ASSERT_TRUE(fc::compression::apply(weak, content_coding::DEFLATE, 1));
+  TEST_ASSERT_TRUE(weak.to_string().find("ETag: W/\"5f1c-2000\"\r\n") != std::string::npos);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_negotiation_follows_q_values);
+  RUN_TEST(test_only_large_textual_bodies_are_eligible);
+  RUN_TEST(test_segments_compress_into_one_stream);
+  RUN_TEST(test_vary_is_not_repeated);
+  RUN_TEST(test_vary_keeps_what_was_there);
+  RUN_TEST(test_compressed_body_gets_a_weak_etag);
+  return UNITY_END();
+}
@@ -0,0 +1,171 @@
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unity.h>
+
+#include "fixture.hpp"
+#include "include/fc.hpp"
+#include "src/scan.hpp"
+
+// xorshift, fixed seed so a failure can be replayed
+static uint64_t state = 0x9e3779b97f4a7c15ull;
+static uint64_t next()
+{
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+static size_t pick(size_t n) { return next() % n; }
+
+static const char *METHODS[] = {"GET", "POST", "PUT", "DELETE", "PATCH", "HEAD", "OPTIONS", "get", "GETS"};
+static const char *PATHS[] = {"/", "/users/42", "/a/b/c?x=1&y=%20", "*", "/~user/!$&'()*+,;=:@", "/a#frag", "/\"<>\\^`{|}", "http://host/x"};
+static const char *NAMES[] = {"Host", "content-length", "Content-Type", "Connection", "proxy-connection", "Transfer-Encoding", "Upgrade", "Cookie", "X-Custom_Header", "Accept"};
+static const char *VALUES[] = {"localhost:8000", "close", "keep-alive", "Keep-Alive", "chunked", "0", "5", "12", "007", "1x", "a\tb", "text/html; q=0.9", "upgrade, close", "\x80\xff", "websocket"};
+static const char NOISE[] = {'\r', '\n', ' ', '\t', ':', '\0', '\x7f', '\x80', 'a', '0', '/', '"'};
+
+static std::string random_request()
+{
+  std::string raw = METHODS[pick(std::size(METHODS))];
+  raw += ' ';
+  raw += PATHS[pick(std::size(PATHS))];
+  raw += pick(8) ? " HTTP/1.1\r\n" : (pick(2) ? " HTTP/1.0\r\n" : " HTTP/2.0\r\n");
+  for (size_t n = pick(6); n > 0; n--) {
+    raw += NAMES[pick(std::size(NAMES))];
+    raw += pick(10) ? ": " : ":";
+    raw += VALUES[pick(std::size(VALUES))];
+    raw += "\r\n";
+  }
+  raw += "\r\n";
+  raw += std::string(pick(20), 'b');
+  // a few bytes overwritten, inserted or dropped
+  for (size_t n = pick(4); n > 0 && !raw.empty(); n--) {
+    size_t at = pick(raw.size());
+    switch (pick(3)) {
+    case 0: raw[at] = NOISE[pick(sizeof(NOISE))]; break;
+    case 1: raw.insert(at, 1, NOISE[pick(sizeof(NOISE))]); break;
+    case 2: raw.erase(at, 1); break;
+    }
+  }
+  if (!pick(10)) raw.resize(pick(raw.size() + 1));
+  return raw;
+}
+
+static size_t fast_hits = 0;
+
+// whatever the fast path accepts must be parsed the same way by llhttp
+static void compare(const std::string &raw)
+{
+  fc::http_parser fast(1024 * 16, 1024), slow(1024 * 16, 1024);
+  fc::request a = fc::request_factory(nullptr, {}, &arena), b = fc::request_factory(nullptr, {}, &arena);
+  size_t fast_parsed = 0, slow_parsed = 0;
+  if (fast.parse_fast(&a, raw.data(), raw.size(), &fast_parsed)) {
+    fast_hits++;
+    TEST_ASSERT_EQUAL_INT_MESSAGE(HPE_PAUSED, slow.execute_llhttp(&b, raw.data(), raw.size(), &slow_parsed), raw.c_str());
+    TEST_ASSERT_EQUAL_MESSAGE(slow_parsed, fast_parsed, raw.c_str());
+    TEST_ASSERT_TRUE_MESSAGE(a.get_method() == b.get_method(), raw.c_str());
+    TEST_ASSERT_TRUE_MESSAGE(a.get_path() == b.get_path(), raw.c_str());
+    TEST_ASSERT_TRUE_MESSAGE(a.get_body() == b.get_body(), raw.c_str());
+    TEST_ASSERT_EQUAL_MESSAGE(b.get_http_minor(), a.get_http_minor(), raw.c_str());
+    TEST_ASSERT_EQUAL_MESSAGE(b.keep_alive(), a.keep_alive(), raw.c_str());
+    TEST_ASSERT_EQUAL_MESSAGE(b.get_headers().size(), a.get_headers().size(), raw.c_str());
+    for (size_t i = 0; i < a.get_headers().size(); i++) {
+      TEST_ASSERT_TRUE_MESSAGE(a.get_headers()[i] == b.get_headers()[i], raw.c_str());
+    }
+    TEST_ASSERT_TRUE_MESSAGE(a.get_header(fc::header::HOST) == b.get_header(fc::header::HOST), raw.c_str());
+  } else {
+    TEST_ASSERT_EQUAL_MESSAGE(0, a.get_headers().size(), raw.c_str());
+  }
+  arena.reset();
+}
+
+void setUp(void)
+{
+  // set stuff up here
+}
+
+void tearDown(void)
+{
+  // clean stuff up here
+}
+
+void test_common_requests_take_the_fast_path()
+{
+  const char *raws[] = {
+      "GET /users/42 HTTP/1.1\r\nHost: localhost:8000\r\nUser-Agent: curl/8.5.0\r\nAccept: */*\r\n\r\n",
+      "POST /users HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/json\r\nContent-Length: 13\r\n\r\n{\"name\":\"fc\"}",
+      "PATCH /users/1 HTTP/1.0\r\nConnection: keep-alive\r\n\r\n",
+      "DELETE /users/1 HTTP/1.1\r\nConnection: close\r\n\r\n",
+  };
+  for (const char *raw : raws) {
+    size_t before = fast_hits;
+    compare(raw);
+    TEST_ASSERT_EQUAL_MESSAGE(before + 1, fast_hits, raw);
+  }
+}
+
+void test_pipelined_requests_stop_after_the_first()
+{
+  const char raw[] = "GET /a HTTP/1.1\r\nHost: x\r\n\r\nGET /b HTTP/1.1\r\nHost: x\r\n\r\n";
+  fc::http_parser parser(1024 * 16, 1024);
+  fc::request req = fc::request_factory(nullptr, {}, &arena);
+  size_t nparsed = 0;
+  TEST_ASSERT_EQUAL_INT(HPE_PAUSED, parser.execute(&req, raw, strlen(raw), &nparsed));
+  TEST_ASSERT_EQUAL(strlen(raw) / 2, nparsed);
+  TEST_ASSERT_TRUE(req.get_path() == "/a");
+  arena.reset();
+}
+
+void test_unusual_requests_fall_back_to_llhttp()
+{
+  const char *raws[] = {
+      "HEAD / HTTP/1.1\r\n\r\n",
+      "GET / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n",
+      "GET / HTTP/1.1\r\nX-Folded: a\r\n b\r\n\r\n",
+      "POST / HTTP/1.1\r\nContent-Length: 10\r\n\r\nshort",
+      "GET / HTTP/1.1\r\nHost: localhost\r\n",
+  };
+  for (const char *raw : raws) {
+    fc::http_parser parser(1024 * 16, 1024);
+    fc::request req = fc::request_factory(nullptr, {}, &arena);
+    size_t nparsed = 0;
+    TEST_ASSERT_FALSE_MESSAGE(parser.parse_fast(&req, raw, strlen(raw), &nparsed), raw);
+    arena.reset();
+  }
+}
+
+void test_fuzz_against_llhttp()
+{
+  for (int i = 0; i < 200000; i++) compare(random_request());
+  // the generator must not be so noisy that the fast path is never taken
+  TEST_ASSERT_GREATER_THAN(10000, fast_hits);
+}
+
+void test_scan_implementations_agree()
+{
+  std::vector<char> buf(256);
+  for (int i = 0; i < 100000; i++) {
+    size_t len = pick(buf.size());
+    for (size_t j = 0; j < len; j++) buf[j] = pick(16) ? 0x20 + pick(0x5f) : (char)pick(256);
+    unsigned char lo = pick(2) ? 0x20 : 0x21;
+    const char *expected = fc::scan::scalar(buf.data(), buf.data() + len, lo);
+    TEST_ASSERT_TRUE(expected == fc::scan::find_unprintable(buf.data(), buf.data() + len, lo));
+#if defined(__x86_64__) || defined(__i386__)
+    if (fc::scan::has_sse42()) TEST_ASSERT_TRUE(expected == fc::scan::sse42(buf.data(), buf.data() + len, lo));
+    if (fc::scan::has_avx2()) TEST_ASSERT_TRUE(expected == fc::scan::avx2(buf.data(), buf.data() + len, lo));
+#endif
+  }
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_common_requests_take_the_fast_path);
+  RUN_TEST(test_pipelined_requests_stop_after_the_first);
+  RUN_TEST(test_unusual_requests_fall_back_to_llhttp);
+  RUN_TEST(test_fuzz_against_llhttp);
+  RUN_TEST(test_scan_implementations_agree);
+  return UNITY_END();
+}
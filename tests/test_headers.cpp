@@ -0,0 +1,86 @@
+#include <cstring>
+#include <string>
+
+#include <unity.h>
+
+#include "fixture.hpp"
+#include "include/fc.hpp"
+
+static const char RAW_GET[] = "GET / HTTP/1.1\r\n"
+                              "host: localhost:8000\r\n"
+                              "Content-Type: application/json\r\n"
+                              "X-Request-Id: 7f3a\r\n"
+                              "AUTHORIZATION: Bearer abc\r\n"
+                              "x-request-id: duplicate\r\n"
+                              "\r\n";
+
+void setUp(void)
+{
+  // set stuff up here
+}
+
+void tearDown(void)
+{
+  arena.reset();
+}
+
+void test_lookup_ignores_case()
+{
+  fc::request req = parse_request(RAW_GET);
+  TEST_ASSERT_TRUE(req.get_header("Host") == "localhost:8000");
+  TEST_ASSERT_TRUE(req.get_header("content-type") == "application/json");
+  TEST_ASSERT_TRUE(req.get_header("Authorization") == "Bearer abc");
+  TEST_ASSERT_FALSE(req.get_header("Cookie").has_value());
+  TEST_ASSERT_FALSE(req.get_header("X-Request").has_value());
+}
+
+void test_first_header_wins()
+{
+  fc::request req = parse_request(RAW_GET);
+  TEST_ASSERT_TRUE(req.get_header("X-REQUEST-ID") == "7f3a");
+}
+
+void test_well_known_slots()
+{
+  fc::request req = parse_request(RAW_GET);
+  TEST_ASSERT_TRUE(req.get_header(fc::header::HOST) == "localhost:8000");
+  TEST_ASSERT_TRUE(req.get_header(fc::header::CONTENT_TYPE) == "application/json");
+  TEST_ASSERT_TRUE(req.get_header(fc::header::AUTHORIZATION) == "Bearer abc");
+  TEST_ASSERT_FALSE(req.get_header(fc::header::CONTENT_LENGTH).has_value());
+}
+
+void test_name_split_across_reads()
+{
+  // the buffer holds both pieces back to back, as the connection input buffer would
+  std::string raw = "GET / HTTP/1.1\r\nContent-Length: 0\r\n\r\n";
+  size_t cut = raw.find("Length");
+  fc::request req = fc::request_factory(nullptr, {}, &arena);
+  size_t nparsed = 0;
+  TEST_ASSERT_EQUAL_INT(HPE_OK, parser.execute(&req, raw.data(), cut, &nparsed));
+  TEST_ASSERT_EQUAL_INT(HPE_PAUSED, parser.execute(&req, raw.data() + cut, raw.size() - cut, &nparsed));
+  TEST_ASSERT_TRUE(req.get_header("content-length") == "0");
+  TEST_ASSERT_TRUE(req.get_header(fc::header::CONTENT_LENGTH) == "0");
+}
+
+void test_more_headers_than_slots()
+{
+  std::string raw = "GET / HTTP/1.1\r\n";
+  for (int i = 0; i < 100; i++) raw += "X-H" + std::to_string(i) + ": " + std::to_string(i) + "\r\n";
+  raw += "Connection: close\r\n\r\n";
+  fc::request req = parse_request(raw);
+  TEST_ASSERT_TRUE(req.get_header("x-h0") == "0");
+  TEST_ASSERT_TRUE(req.get_header("x-h99") == "99");
+  TEST_ASSERT_TRUE(req.get_header(fc::header::CONNECTION) == "close");
+  TEST_ASSERT_FALSE(req.get_header("x-h100").has_value());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_lookup_ignores_case);
+  RUN_TEST(test_first_header_wins);
+  RUN_TEST(test_well_known_slots);
+  RUN_TEST(test_name_split_across_reads);
+  RUN_TEST(test_more_headers_than_slots);
+  return UNITY_END();
+}
@@ -0,0 +1,149 @@
+#include <string>
+
+#include <unity.h>
+
+#include "fixture.hpp"
+#include "external/nlohmann/json.hpp"
+#include "include/fc.hpp"
+
+static std::string raw;
+
+// request carrying 'body', the raw bytes live until the next call
+static fc::request post(const std::string &body)
+{
+  raw = "POST /users HTTP/1.1\r\nHost: x\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+  return parse_request(raw);
+}
+
+// status of the 'http_error' thrown by 'fn', 200 when none was
+template <typename F> static fc::status error_of(F fn)
+{
+  try {
+    fn();
+  } catch (const fc::http_error &e) {
+    return e.get_status();
+  }
+  return fc::status::OK;
+}
+
+// the body of a serialized response, parsed back
+static nlohmann::json body_of(const fc::response &res)
+{
+  std::string raw = res.to_string();
+  TEST_ASSERT_TRUE(raw.find("Content-Type: application/json\r\n") != std::string::npos);
+  return nlohmann::json::parse(raw.substr(raw.find("\r\n\r\n") + 4));
+}
+
+void setUp(void)
+{
+  // set stuff up here
+}
+
+void tearDown(void)
+{
+  arena.reset();
+}
+
+void test_writer_matches_the_tree()
+{
+  fc::response res = fc::response::ok();
+  {
+    fc::json_writer w(res);
+    w.begin_object().key("users").begin_array();
+    for (int i = 0; i < 3; i++) {
+      w.begin_object().key("id").value(i).key("name").value("user " + std::to_string(i)).key("admin").value(i == 0).end_object();
+    }
+    w.end_array();
+    w.key("total").value(3u).key("ratio").value(0.5).key("whole").value(2.0).key("missing").value(nullptr);
+    w.key("empty").begin_object().end_object().key("none").begin_array().end_array();
+    w.key("tree").value(nlohmann::json{{"a", {1, 2}}});
+    w.end_object();
+  }
+  nlohmann::json expected = {{"users", nlohmann::json::array()}, {"total", 3}, {"ratio", 0.5}, {"whole", 2.0}, {"missing", nullptr}, {"empty", nlohmann::json::object()}, {"none", nlohmann::json::array()}, {"tree", {{"a", {1, 2}}}}};
+  for (int i = 0; i < 3; i++) expected["users"].push_back({{"id", i}, {"name", "user " + std::to_string(i)}, {"admin", i == 0}});
+  TEST_ASSERT_TRUE(expected == body_of(res));
+}
+
+void test_strings_are_escaped_as_nlohmann_does()
+{
+  std::string tricky = std::string("quote \" backslash \\ newline \n tab \t nul ") + '\0' + " \x1f end \xc3\xa9";
+  fc::response res = fc::response::ok();
+  {
+    fc::json_writer w(res);
+    w.begin_array().value(tricky).value(2.0).value(-7).end_array();
+  }
+  std::string raw = res.to_string();
+  TEST_ASSERT_TRUE(nlohmann::json::array({tricky, 2.0, -7}).dump() == raw.substr(raw.find("\r\n\r\n") + 4));
+}
+
+void test_large_lists_are_cut_into_segments()
+{
+  fc::response res = fc::response::ok(fc::status::CREATED);
+  nlohmann::json expected = nlohmann::json::array();
+  {
+    fc::json_writer w(res);
+    w.begin_array();
+    for (int i = 0; i < 20000; i++) {
+      w.begin_object().key("id").value(i).key("email").value("user" + std::to_string(i) + "@email.com").end_object();
+      expected.push_back({{"id", i}, {"email", "user" + std::to_string(i) + "@email.com"}});
+    }
+    w.end_array();
+  }
+  TEST_ASSERT_TRUE(res.to_string().starts_with("HTTP/1.1 201"));
+  TEST_ASSERT_TRUE(expected == body_of(res));
+  TEST_ASSERT_TRUE(res.content_length() == expected.dump().size());
+}
+
+void test_json_response_round_trips()
+{
+  const nlohmann::json tree = {{"id", 1}, {"tags", {"a", "b"}}};
+  TEST_ASSERT_TRUE(tree == body_of(fc::response::json(tree)));
+}
+
+void test_body_is_parsed_once()
+{
+  fc::request req = post(R"({"email": "a@b.c", "age": 42})");
+  const nlohmann::json &first = req.json();
+  TEST_ASSERT_TRUE(first["age"] == 42);
+  TEST_ASSERT_TRUE(&first == &req.json());
+  // copies share the parsed body
+  fc::request copy = req;
+  TEST_ASSERT_TRUE(&first == &copy.json());
+}
+
+void test_malformed_body_is_a_bad_request()
+{
+  fc::request req = post(R"({"email": "a@b.c", )");
+  TEST_ASSERT_EQUAL_INT(400, static_cast<int>(error_of([&] { req.json(); })));
+  TEST_ASSERT_EQUAL_INT(400, static_cast<int>(error_of([&] { req.json_fields({"age"}); })));
+  fc::request empty = post("");
+  TEST_ASSERT_EQUAL_INT(400, static_cast<int>(error_of([&] { empty.json(); })));
+}
+
+void test_fields_are_extracted_without_the_rest()
+{
+  fc::request req = post(R"({"skip": {"age": 1, "deep": [[{"email": 0}]]}, "age": 42, "tags": ["a", {"b": [1, 2.5, null]}], "email": "a\"b", "age": 43})");
+  auto fields = req.json_fields({"email", "tags", "age", "missing"});
+  TEST_ASSERT_TRUE(fields[0] == "a\"b");
+  TEST_ASSERT_TRUE(fields[1] == nlohmann::json::parse(R"(["a", {"b": [1, 2.5, null]}])"));
+  TEST_ASSERT_TRUE(fields[2] == 42);
+  TEST_ASSERT_TRUE(fields[3].is_null());
+
+  // parsing stops once every field was found, what follows is never looked at
+  fc::request early = post(R"({"id": 7, "rest": [1, 2, )");
+  TEST_ASSERT_TRUE(early.json_fields({"id"})[0] == 7);
+  TEST_ASSERT_EQUAL_INT(400, static_cast<int>(error_of([&] { early.json(); })));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_writer_matches_the_tree);
+  RUN_TEST(test_strings_are_escaped_as_nlohmann_does);
+  RUN_TEST(test_large_lists_are_cut_into_segments);
+  RUN_TEST(test_json_response_round_trips);
+  RUN_TEST(test_body_is_parsed_once);
+  RUN_TEST(test_malformed_body_is_a_bad_request);
+  RUN_TEST(test_fields_are_extracted_without_the_rest);
+  return UNITY_END();
+}
@@ -0,0 +1,119 @@
+#include <memory>
+#include <string>
+
+#include <unity.h>
+
+#include "server.hpp"
+
+// stopped in 'tearDown', a failed assertion leaves the test function without unwinding it
+static std::unique_ptr<test_server> server;
+
+// answers with the name in the path, telling pipelined responses apart
+static fc::response echo(fc::request &req)
+{
+  return fc::response::json(req.get_param("name").value());
+}
+
+static void start(unsigned max_requests = 0)
+{
+  server = std::make_unique<test_server>();
+  server->m_settings.m_max_requests_per_conn = max_requests;
+  server->m_router.add(fc::method::GET, "/echo/:name", echo, {});
+  server->start();
+}
+
+static bool has_line(const test_response &res, const char *line) { return res.m_head.find(line) != std::string::npos; }
+
+void setUp(void)
+{
+  // set stuff up here
+}
+
+void tearDown(void)
+{
+  server.reset();
+}
+
+void test_pipelined_requests_are_answered_in_order()
+{
+  start();
+  test_client client(server->m_port);
+  // one write, so one read most of the time, with a 404 in the middle
+  client.send("GET /echo/a HTTP/1.1\r\nHost: x\r\n\r\n"
+              "GET /missing HTTP/1.1\r\nHost: x\r\n\r\n"
+              "GET /echo/b HTTP/1.1\r\nHost: x\r\n\r\n"
+              "GET /echo/c HTTP/1.1\r\nHost: x\r\n\r\n");
+  test_response res = client.read();
+  TEST_ASSERT_EQUAL(200, res.m_status);
+  TEST_ASSERT_EQUAL_STRING("\"a\"", res.m_body.c_str());
+  TEST_ASSERT_FALSE(has_line(res, "connection:"));
+  TEST_ASSERT_EQUAL(404, client.read().m_status);
+  TEST_ASSERT_EQUAL_STRING("\"b\"", client.read().m_body.c_str());
+  TEST_ASSERT_EQUAL_STRING("\"c\"", client.read().m_body.c_str());
+  // still open for more
+  client.send("GET /echo/d HTTP/1.1\r\nHost: x\r\n\r\n");
+  TEST_ASSERT_EQUAL_STRING("\"d\"", client.read().m_body.c_str());
+}
+
+void test_connection_close_ends_the_pipeline()
+{
+  start();
+  test_client client(server->m_port);
+  client.send("GET /echo/a HTTP/1.1\r\nHost: x\r\n\r\n"
+              "GET /echo/b HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n"
+              "GET /echo/c HTTP/1.1\r\nHost: x\r\n\r\n");
+  TEST_ASSERT_EQUAL_STRING("\"a\"", client.read().m_body.c_str());
+  test_response res = client.read();
+  TEST_ASSERT_EQUAL_STRING("\"b\"", res.m_body.c_str());
+  TEST_ASSERT_TRUE(has_line(res, "connection: close\r\n"));
+  // the request after it is never answered
+  TEST_ASSERT_TRUE(client.closed());
+}
+
+void test_http_1_0_closes_unless_asked_to_keep_alive()
+{
+  start();
+  {
+    test_client client(server->m_port);
+    client.send("GET /echo/a HTTP/1.0\r\n\r\n");
+    test_response res = client.read();
+    TEST_ASSERT_EQUAL_STRING("\"a\"", res.m_body.c_str());
+    TEST_ASSERT_TRUE(has_line(res, "connection: close\r\n"));
+    TEST_ASSERT_TRUE(client.closed());
+  }
+  test_client client(server->m_port);
+  client.send("GET /echo/a HTTP/1.0\r\nConnection: keep-alive\r\n\r\n");
+  test_response res = client.read();
+  TEST_ASSERT_EQUAL_STRING("\"a\"", res.m_body.c_str());
+  // a 1.0 client only keeps the connection when told it was kept
+  TEST_ASSERT_TRUE(has_line(res, "connection: keep-alive\r\n"));
+  client.send("GET /echo/b HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n");
+  TEST_ASSERT_EQUAL_STRING("\"b\"", client.read().m_body.c_str());
+  client.send("GET /echo/c HTTP/1.0\r\n\r\n");
+  res = client.read();
+  TEST_ASSERT_EQUAL_STRING("\"c\"", res.m_body.c_str());
+  TEST_ASSERT_TRUE(client.closed());
+}
+
+void test_connection_closed_after_max_requests()
+{
+  start(2);
+  test_client client(server->m_port);
+  client.send("GET /echo/a HTTP/1.1\r\nHost: x\r\n\r\n");
+  TEST_ASSERT_FALSE(has_line(client.read(), "connection:"));
+  client.send("GET /echo/b HTTP/1.1\r\nHost: x\r\n\r\n");
+  test_response res = client.read();
+  TEST_ASSERT_EQUAL_STRING("\"b\"", res.m_body.c_str());
+  TEST_ASSERT_TRUE(has_line(res, "connection: close\r\n"));
+  TEST_ASSERT_TRUE(client.closed());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_pipelined_requests_are_answered_in_order);
+  RUN_TEST(test_connection_close_ends_the_pipeline);
+  RUN_TEST(test_http_1_0_closes_unless_asked_to_keep_alive);
+  RUN_TEST(test_connection_closed_after_max_requests);
+  return UNITY_END();
+}
@@ -0,0 +1,107 @@
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <unity.h>
+
+#include "fixture.hpp"
+#include "include/fc.hpp"
+#include "src/metrics.hpp"
+#include "src/router.hpp"
+
+static fc::response noop(fc::request &) { return fc::response::ok(); }
+
+void setUp(void)
+{
+  // set stuff up here
+}
+
+void tearDown(void)
+{
+  // clean stuff up here
+}
+
+void test_histogram_buckets_hold_their_values()
+{
+  using h = fc::latency_histogram;
+  for (uint64_t us : {0ull, 7ull, 8ull, 15ull, 16ull, 17ull, 100ull, 1000ull, 123456ull, (1ull << 35) + 5}) {
+    unsigned bucket = h::bucket(us);
+    TEST_ASSERT_TRUE(bucket < h::NBUCKETS);
+    TEST_ASSERT_TRUE(us < h::upper_bound(bucket));
+    TEST_ASSERT_TRUE(0 == bucket || us >= h::upper_bound(bucket - 1));
+  }
+  // within 12.5% of the value
+  TEST_ASSERT_TRUE(h::upper_bound(h::bucket(1000)) <= 1000 + 1000 / 8);
+  // past the last bucket values are clamped
+  TEST_ASSERT_EQUAL(h::NBUCKETS - 1, h::bucket(~0ull));
+}
+
+void test_render_prometheus_text()
+{
+  std::vector<std::string> names = {"GET /users/:id", "GET /say \"hi\""};
+  fc::worker_stats stats;
+  stats.enable(names.size() + 1);
+  stats.record(1, fc::status::OK, 100, 200, 150000);    // 150 us
+  stats.record(1, fc::status::NOT_FOUND, 50, 20, 2000000); // 2 ms
+  stats.record(0, fc::status::BAD_REQUEST, 10, 30, 1000);
+  fc::bump(stats.m_accepted, 3);
+  fc::bump(stats.m_closed);
+  fc::bump(stats.m_timeouts[static_cast<size_t>(fc::timeout::BODY) - 1], 2);
+  std::string out = fc::metrics::render(names, {&stats});
+
+  TEST_ASSERT_NOT_NULL(strstr(out.c_str(), "falcon_requests_total{route=\"GET /users/:id\",code=\"2xx\"} 1\n"));
+  TEST_ASSERT_NOT_NULL(strstr(out.c_str(), "falcon_requests_total{route=\"GET /users/:id\",code=\"4xx\"} 1\n"));
+  TEST_ASSERT_NOT_NULL(strstr(out.c_str(), "falcon_requests_total{route=\"unmatched\",code=\"4xx\"} 1\n"));
+  TEST_ASSERT_NOT_NULL(strstr(out.c_str(), "falcon_request_bytes_total{route=\"GET /users/:id\"} 150\n"));
+  TEST_ASSERT_NOT_NULL(strstr(out.c_str(), "falcon_response_bytes_total{route=\"GET /users/:id\"} 220\n"));
+  TEST_ASSERT_NOT_NULL(strstr(out.c_str(), "falcon_request_duration_seconds_bucket{route=\"GET /users/:id\",le=\"0.0001\"} 0\n"));
+  TEST_ASSERT_NOT_NULL(strstr(out.c_str(), "falcon_request_duration_seconds_bucket{route=\"GET /users/:id\",le=\"0.00025\"} 1\n"));
+  TEST_ASSERT_NOT_NULL(strstr(out.c_str(), "falcon_request_duration_seconds_bucket{route=\"GET /users/:id\",le=\"0.0025\"} 2\n"));
+  TEST_ASSERT_NOT_NULL(strstr(out.c_str(), "falcon_request_duration_seconds_bucket{route=\"GET /users/:id\",le=\"+Inf\"} 2\n"));
+  TEST_ASSERT_NOT_NULL(strstr(out.c_str(), "falcon_request_duration_seconds_count{route=\"GET /users/:id\"} 2\n"));
+  TEST_ASSERT_NOT_NULL(strstr(out.c_str(), "falcon_connections_open 2\n"));
+  TEST_ASSERT_NOT_NULL(strstr(out.c_str(), "falcon_connection_timeouts_total{kind=\"body\"} 2\n"));
+  TEST_ASSERT_NOT_NULL(strstr(out.c_str(), "falcon_connection_timeouts_total{kind=\"idle\"} 0\n"));
+  // routes without requests are left out
+  TEST_ASSERT_NULL(strstr(out.c_str(), "say"));
+}
+
+void test_open_connections_never_wrap()
+{
+  fc::worker_stats stats;
+  // as read while another thread accepted then closed a connection
+  fc::bump(stats.m_closed);
+  std::string out = fc::metrics::render({}, {&stats});
+  TEST_ASSERT_NOT_NULL(strstr(out.c_str(), "falcon_connections_open 0\n"));
+}
+
+void test_routes_get_ids()
+{
+  fc::root_router router;
+  router.add(fc::method::GET, "/users", noop, {});
+  router.add(fc::method::GET, "/users/:id", noop, {});
+  router.add_static(&fc::routes<fc::get<"/health", noop>, fc::post<"/health", noop>>::dispatch,
+                    {fc::routes<fc::get<"/health", noop>, fc::post<"/health", noop>>::m_routes.begin(), fc::routes<fc::get<"/health", noop>, fc::post<"/health", noop>>::m_routes.end()});
+  TEST_ASSERT_EQUAL(4, router.m_route_names.size());
+  TEST_ASSERT_EQUAL_STRING("POST /health", router.m_route_names[3].c_str());
+
+  const char *raws[] = {"GET /users/7 HTTP/1.1\r\n\r\n", "POST /health HTTP/1.1\r\n\r\n"};
+  unsigned expected[] = {2, 4};
+  for (int i = 0; i < 2; i++) {
+    fc::request req = parse_request(raws[i]);
+    std::optional<fc::response> res;
+    TEST_ASSERT_TRUE(router.dispatch_static(req, res) || router.match(req));
+    TEST_ASSERT_EQUAL(expected[i], fc::metrics::route_of(req));
+  }
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_histogram_buckets_hold_their_values);
+  RUN_TEST(test_render_prometheus_text);
+  RUN_TEST(test_open_connections_never_wrap);
+  RUN_TEST(test_routes_get_ids);
+  return UNITY_END();
+}
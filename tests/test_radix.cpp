@@ -0,0 +1,120 @@
+#include <string>
+#include <string_view>
+
+#include <unity.h>
+
+#include "include/fc.hpp"
+#include "src/arena.hpp"
+#include "src/router.hpp"
+
+static fc::response noop(fc::request &req) { return fc::response::ok(); }
+
+static fc::root_router router;
+static fc::arena arena;
+static fc::route_params params;
+
+// handlers registered for 'path', its dynamic segments are left in 'params'
+static const fc::frag_handlers_t *lookup(std::string_view path)
+{
+  params.clear();
+  return router.find(fc::root_router::canonical_path(path, &arena), params);
+}
+
+// value of the dynamic segment named 'name' in the last lookup, "" when there is none
+static std::string param(std::string_view name)
+{
+  for (auto &[key, value] : params)
+    if (key == name) return std::string(value);
+  return "";
+}
+
+void setUp(void)
+{
+  // set stuff up here
+}
+
+void tearDown(void)
+{
+  // clean stuff up here
+}
+
+void test_static_takes_priority_over_dynamic()
+{
+  const fc::frag_handlers_t *me = lookup("/users/me");
+  TEST_ASSERT_NOT_NULL(me);
+  TEST_ASSERT_EQUAL_INT(0, params.size());
+  TEST_ASSERT_TRUE(me != lookup("/users/42"));
+  TEST_ASSERT_EQUAL_STRING("42", param("id").c_str());
+}
+
+void test_backtracks_to_dynamic_when_static_branch_dead_ends()
+{
+  // "/users/me" shares "me" with the value, the static branch fails on the remaining "x"
+  TEST_ASSERT_NOT_NULL(lookup("/users/mex"));
+  TEST_ASSERT_EQUAL_STRING("mex", param("id").c_str());
+  // "/users/:id/posts" only exists under the dynamic branch
+  TEST_ASSERT_NOT_NULL(lookup("/users/me/posts"));
+  TEST_ASSERT_EQUAL_STRING("me", param("id").c_str());
+}
+
+void test_split_prefixes_keep_both_routes()
+{
+  TEST_ASSERT_NOT_NULL(lookup("/api/v1/orders"));
+  TEST_ASSERT_NOT_NULL(lookup("/api/v1/orgs"));
+  TEST_ASSERT_NULL(lookup("/api/v1/or"));
+  TEST_ASSERT_NULL(lookup("/api/v1/ordersx"));
+}
+
+void test_wildcard_comes_last()
+{
+  TEST_ASSERT_NOT_NULL(lookup("/static/css/site.css"));
+  TEST_ASSERT_TRUE(lookup("/static/index") != lookup("/static/css/site.css"));
+  TEST_ASSERT_NULL(lookup("/static"));
+}
+
+void test_path_is_canonicalized()
+{
+  TEST_ASSERT_TRUE(lookup("/users/me") == lookup("//users///me/?tab=1"));
+  TEST_ASSERT_NOT_NULL(lookup("/"));
+  TEST_ASSERT_TRUE(lookup("/") == lookup(""));
+}
+
+void test_conflicting_routes_throw()
+{
+  bool thrown = false;
+  try {
+    router.add(fc::method::GET, "/users/:uid/likes", noop, {});
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  TEST_ASSERT_TRUE(thrown);
+
+  thrown = false;
+  try {
+    router.add(fc::method::GET, "/users/me", noop, {});
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  TEST_ASSERT_TRUE(thrown);
+}
+
+int main()
+{
+  router.add(fc::method::GET, "/", noop, {});
+  router.add(fc::method::GET, "/users/me", noop, {});
+  router.add(fc::method::GET, "/users/:id", noop, {});
+  router.add(fc::method::GET, "/users/:id/posts", noop, {});
+  router.add(fc::method::GET, "/api/v1/orders", noop, {});
+  router.add(fc::method::GET, "/api/v1/orgs", noop, {});
+  router.add(fc::method::GET, "/static/index", noop, {});
+  router.add(fc::method::GET, "/static/*", noop, {});
+
+  UNITY_BEGIN();
+  RUN_TEST(test_static_takes_priority_over_dynamic);
+  RUN_TEST(test_backtracks_to_dynamic_when_static_branch_dead_ends);
+  RUN_TEST(test_split_prefixes_keep_both_routes);
+  RUN_TEST(test_wildcard_comes_last);
+  RUN_TEST(test_path_is_canonicalized);
+  RUN_TEST(test_conflicting_routes_throw);
+  return UNITY_END();
+}
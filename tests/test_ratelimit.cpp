@@ -0,0 +1,106 @@
+#include <string>
+
+#include <unity.h>
+
+#include "fixture.hpp"
+#include "include/fc.hpp"
+#include "src/ratelimit.hpp"
+#include "src/router.hpp"
+
+static const uint64_t SECOND = 1000000000;
+
+static std::string raw;
+
+static fc::response allowed(fc::request &) { return fc::response::ok(); }
+
+// status of the response to a request with 'forwarded' as X-Forwarded-For, going through 'router'
+static fc::status call(const fc::root_router &router, const std::string &forwarded)
+{
+  raw = "GET / HTTP/1.1\r\nHost: x\r\nX-Forwarded-For: " + forwarded + "\r\n\r\n";
+  fc::request req = parse_request(raw);
+  TEST_ASSERT_TRUE(router.match(req));
+  fc::status status = req.next().get_status();
+  arena.reset();
+  return status;
+}
+
+void setUp(void)
+{
+  // set stuff up here
+}
+
+void tearDown(void)
+{
+  // clean stuff up here
+}
+
+void test_buckets_refill_over_time()
+{
+  fc::rate_limit::table table(2, 3, 1024);
+  // a full bucket lets a burst through
+  for (int i = 0; i < 3; i++) TEST_ASSERT_TRUE(table.take(42, 0));
+  TEST_ASSERT_FALSE(table.take(42, 0));
+  // other clients have their own bucket
+  TEST_ASSERT_TRUE(table.take(43, 0));
+  // 2 per second
+  TEST_ASSERT_TRUE(table.take(42, SECOND / 2));
+  TEST_ASSERT_FALSE(table.take(42, SECOND / 2));
+  TEST_ASSERT_TRUE(table.take(42, 10 * SECOND));
+  TEST_ASSERT_TRUE(table.take(42, 10 * SECOND));
+  TEST_ASSERT_TRUE(table.take(42, 10 * SECOND));
+  TEST_ASSERT_FALSE(table.take(42, 10 * SECOND));
+}
+
+void test_least_recently_seen_client_is_evicted()
+{
+  // one bucket per shard, keys differing in the high bits only all land in the first shard
+  fc::rate_limit::table table(1, 1, FC_RATE_LIMIT_SHARDS * 2);
+  const size_t a = 1, b = 2, c = 3;
+  TEST_ASSERT_TRUE(table.take(a, 0));
+  TEST_ASSERT_TRUE(table.take(b, 0));
+  TEST_ASSERT_FALSE(table.take(a, 0));
+  // 'b' is the oldest now, 'c' takes its place
+  TEST_ASSERT_TRUE(table.take(c, 0));
+  TEST_ASSERT_FALSE(table.take(a, 0));
+  TEST_ASSERT_FALSE(table.take(c, 0));
+  TEST_ASSERT_EQUAL(2, table.m_shards[0].m_buckets.size());
+  // forgotten, it starts over with a full bucket
+  TEST_ASSERT_TRUE(table.take(b, 0));
+}
+
+void test_client_sent_entries_are_ignored()
+{
+  fc::root_router router;
+  // two proxies: the outer one appends the client address, the inner one the outer's
+  router.add(fc::method::GET, "/", allowed, {fc::rate_limit(1, 1, "X-Forwarded-For", 2)});
+  TEST_ASSERT_EQUAL_INT(200, static_cast<int>(call(router, "192.0.2.1, 10.0.0.1")));
+  // whatever the client puts in front doesn't get it a new bucket
+  TEST_ASSERT_EQUAL_INT(429, static_cast<int>(call(router, "198.51.100.7, 192.0.2.1, 10.0.0.1")));
+  TEST_ASSERT_EQUAL_INT(429, static_cast<int>(call(router, "198.51.100.8,192.0.2.1 , 10.0.0.1")));
+  TEST_ASSERT_EQUAL_INT(200, static_cast<int>(call(router, "198.51.100.8, 192.0.2.2, 10.0.0.1")));
+}
+
+void test_middleware_answers_429()
+{
+  fc::root_router router;
+  router.add(fc::method::GET, "/", allowed, {fc::rate_limit(1, 2, "X-Forwarded-For")});
+  // the proxy in front appended the client address
+  TEST_ASSERT_EQUAL_INT(200, static_cast<int>(call(router, "192.0.2.1")));
+  TEST_ASSERT_EQUAL_INT(200, static_cast<int>(call(router, "203.0.113.9, 192.0.2.1")));
+  TEST_ASSERT_EQUAL_INT(429, static_cast<int>(call(router, "192.0.2.1")));
+  TEST_ASSERT_EQUAL_INT(200, static_cast<int>(call(router, "192.0.2.2")));
+
+  std::string refused = fc::response::canned(fc::status::TOO_MANY_REQUESTS).to_string();
+  TEST_ASSERT_TRUE(refused.starts_with("HTTP/1.1 429 Too Many Requests\r\n"));
+  TEST_ASSERT_TRUE(refused.find("\r\nRetry-After: 1\r\n") != std::string::npos);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_buckets_refill_over_time);
+  RUN_TEST(test_least_recently_seen_client_is_evicted);
+  RUN_TEST(test_client_sent_entries_are_ignored);
+  RUN_TEST(test_middleware_answers_429);
+  return UNITY_END();
+}
@@ -0,0 +1,146 @@
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <unity.h>
+
+#include "fixture.hpp"
+
+static const std::string RAW_POST = "POST /users/42?fields=name HTTP/1.1\r\n"
+                                    "Host: localhost:8000\r\n"
+                                    "Authorization: Bearer uGhTVjLwDb0R\r\n"
+                                    "Content-Length: 26\r\n"
+                                    "\r\n"
+                                    "abcdefghijklmnopqrstuvwxyz";
+
+// whether 'view' lies within 'buf'
+static bool inside(std::string_view view, const std::vector<char> &buf)
+{
+  return view.data() >= buf.data() && view.data() + view.size() <= buf.data() + buf.size();
+}
+
+void setUp(void)
+{
+  // set stuff up here
+}
+
+void tearDown(void)
+{
+  arena.reset();
+}
+
+void test_head_split_anywhere()
+{
+  // the input buffer holds every read back to back, as the connection one does
+  for (size_t cut = 1; cut < RAW_POST.find("\r\n\r\n"); cut++) {
+    fc::request req = fc::request_factory(nullptr, {}, &arena);
+    size_t nparsed = 0;
+    TEST_ASSERT_EQUAL_INT(HPE_OK, parser.execute(&req, RAW_POST.data(), cut, &nparsed));
+    TEST_ASSERT_EQUAL(cut, nparsed);
+    TEST_ASSERT_EQUAL_INT(HPE_PAUSED, parser.execute(&req, RAW_POST.data() + cut, RAW_POST.size() - cut, &nparsed));
+    TEST_ASSERT_EQUAL(RAW_POST.size() - cut, nparsed);
+    TEST_ASSERT_TRUE(req.get_path() == "/users/42?fields=name");
+    TEST_ASSERT_TRUE(req.get_header("Host") == "localhost:8000");
+    TEST_ASSERT_TRUE(req.get_header(fc::header::AUTHORIZATION) == "Bearer uGhTVjLwDb0R");
+    TEST_ASSERT_TRUE(req.get_body() == "abcdefghijklmnopqrstuvwxyz");
+    arena.reset();
+  }
+}
+
+void test_head_moved_to_a_larger_buffer()
+{
+  // cut in the middle of the Authorization value, then the worker grows the buffer as
+  // 'worker::reserve_input' does: bytes copied over, views rebased, old buffer gone
+  size_t cut = RAW_POST.find("uGhT") + 2;
+  std::vector<char> small(RAW_POST.begin(), RAW_POST.begin() + cut);
+  fc::request req = fc::request_factory(nullptr, {}, &arena);
+  size_t nparsed = 0;
+  TEST_ASSERT_EQUAL_INT(HPE_OK, parser.execute(&req, small.data(), small.size(), &nparsed));
+
+  std::vector<char> large(RAW_POST.begin(), RAW_POST.end());
+  fc::http_parser::rebase(&req, small.data(), small.size(), large.data());
+  std::fill(small.begin(), small.end(), '#');
+  TEST_ASSERT_EQUAL_INT(HPE_PAUSED, parser.execute(&req, large.data() + cut, large.size() - cut, &nparsed));
+  TEST_ASSERT_TRUE(req.get_path() == "/users/42?fields=name");
+  TEST_ASSERT_TRUE(req.get_header("host") == "localhost:8000");
+  TEST_ASSERT_TRUE(req.get_header("authorization") == "Bearer uGhTVjLwDb0R");
+  TEST_ASSERT_TRUE(inside(req.get_path(), large));
+  TEST_ASSERT_TRUE(inside(*req.get_header("authorization"), large));
+  TEST_ASSERT_TRUE(req.get_body() == "abcdefghijklmnopqrstuvwxyz");
+}
+
+void test_body_in_slices_of_one_buffer()
+{
+  size_t head = RAW_POST.find("\r\n\r\n") + 4;
+  std::vector<char> buf(RAW_POST.begin(), RAW_POST.end());
+  fc::request req = fc::request_factory(nullptr, {}, &arena);
+  size_t nparsed = 0;
+  TEST_ASSERT_EQUAL_INT(HPE_OK, parser.execute(&req, buf.data(), head + 3, &nparsed));
+  TEST_ASSERT_EQUAL_INT(HPE_OK, parser.execute(&req, buf.data() + head + 3, 10, &nparsed));
+  TEST_ASSERT_EQUAL_INT(HPE_PAUSED, parser.execute(&req, buf.data() + head + 13, buf.size() - head - 13, &nparsed));
+  // slices following each other make one view into the buffer, nothing copied
+  TEST_ASSERT_TRUE(req.get_body() == "abcdefghijklmnopqrstuvwxyz");
+  TEST_ASSERT_TRUE(inside(req.get_body(), buf));
+}
+
+void test_body_in_slices_of_several_buffers()
+{
+  size_t head = RAW_POST.find("\r\n\r\n") + 4;
+  std::vector<char> first(RAW_POST.begin(), RAW_POST.begin() + head + 5);
+  fc::request req = fc::request_factory(nullptr, {}, &arena);
+  size_t nparsed = 0;
+  TEST_ASSERT_EQUAL_INT(HPE_OK, parser.execute(&req, first.data(), first.size(), &nparsed));
+  TEST_ASSERT_TRUE(req.get_body() == "abcde");
+  // the head stays where it is and the rest of the body comes in fresh slabs, see
+  // 'worker::reserve_input'
+  parser.m_copy_body = true;
+  std::vector<char> second(RAW_POST.begin() + head + 5, RAW_POST.begin() + head + 20);
+  std::vector<char> third(RAW_POST.begin() + head + 20, RAW_POST.end());
+  TEST_ASSERT_EQUAL_INT(HPE_OK, parser.execute(&req, second.data(), second.size(), &nparsed));
+  std::fill(second.begin(), second.end(), '#');
+  TEST_ASSERT_EQUAL_INT(HPE_PAUSED, parser.execute(&req, third.data(), third.size(), &nparsed));
+  TEST_ASSERT_TRUE(req.get_body() == "abcdefghijklmnopqrstuvwxyz");
+  TEST_ASSERT_TRUE(req.get_header("Host") == "localhost:8000");
+}
+
+void test_chunked_body_in_slices()
+{
+  const std::string raw = "POST /upload HTTP/1.1\r\nHost: x\r\nTransfer-Encoding: chunked\r\n\r\n"
+                          "5\r\nhello\r\n7\r\n, world\r\n0\r\n\r\n";
+  for (size_t cut = raw.find("\r\n\r\n") + 1; cut < raw.size(); cut++) {
+    fc::request req = fc::request_factory(nullptr, {}, &arena);
+    size_t nparsed = 0;
+    TEST_ASSERT_EQUAL_INT(HPE_OK, parser.execute(&req, raw.data(), cut, &nparsed));
+    TEST_ASSERT_EQUAL_INT(HPE_PAUSED, parser.execute(&req, raw.data() + cut, raw.size() - cut, &nparsed));
+    TEST_ASSERT_TRUE(req.get_body() == "hello, world");
+    arena.reset();
+  }
+}
+
+void test_joined_body_follows_copies_and_moves()
+{
+  const std::string raw = "POST /upload HTTP/1.1\r\nHost: x\r\nTransfer-Encoding: chunked\r\n\r\n"
+                          "5\r\nhello\r\n7\r\n, world\r\n0\r\n\r\n";
+  std::optional<fc::request> original(parse_request(raw));
+  fc::request copy = *original;
+  original.reset();
+  TEST_ASSERT_TRUE(copy.get_body() == "hello, world");
+  // the view follows the buffer wherever it was moved
+  std::optional<fc::request> moved(std::move(copy));
+  fc::request last = std::move(*moved);
+  moved.reset();
+  TEST_ASSERT_TRUE(last.get_body() == "hello, world");
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_head_split_anywhere);
+  RUN_TEST(test_head_moved_to_a_larger_buffer);
+  RUN_TEST(test_body_in_slices_of_one_buffer);
+  RUN_TEST(test_body_in_slices_of_several_buffers);
+  RUN_TEST(test_chunked_body_in_slices);
+  RUN_TEST(test_joined_body_follows_copies_and_moves);
+  return UNITY_END();
+}
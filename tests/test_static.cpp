@@ -0,0 +1,124 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+#include <unity.h>
+
+#include "fixture.hpp"
+#include "include/fc.hpp"
+
+static std::filesystem::path dir;
+
+// serves 'file' for a GET carrying 'headers' and returns the whole serialized response
+static std::string serve(const char *file, const std::string &headers = "")
+{
+  std::string raw = "GET /" + std::string(file) + " HTTP/1.1\r\n" + headers + "\r\n";
+  fc::request req = parse_request(raw);
+  return fc::response::send(req, dir / file).to_string();
+}
+
+static std::string header(const std::string &res, const std::string &name)
+{
+  size_t at = res.find("\r\n" + name + ": ");
+  if (at == std::string::npos) return "";
+  at += name.size() + 4;
+  return res.substr(at, res.find("\r\n", at) - at);
+}
+
+static std::string body(const std::string &res) { return res.substr(res.find("\r\n\r\n") + 4); }
+
+void setUp(void)
+{
+  // set stuff up here
+}
+
+void tearDown(void)
+{
+  // clean stuff up here
+}
+
+void test_whole_file_with_validators()
+{
+  std::string res = serve("hello.txt");
+  TEST_ASSERT_TRUE(res.starts_with("HTTP/1.1 200 OK\r\n"));
+  TEST_ASSERT_EQUAL_STRING("text/plain; charset=utf-8", header(res, "Content-Type").c_str());
+  TEST_ASSERT_EQUAL_STRING("hello world", body(res).c_str());
+  TEST_ASSERT_FALSE(header(res, "ETag").empty());
+  TEST_ASSERT_FALSE(header(res, "Last-Modified").empty());
+}
+
+void test_conditional_get_is_not_modified()
+{
+  std::string res = serve("hello.txt");
+  std::string etag = header(res, "ETag"), last_modified = header(res, "Last-Modified");
+
+  res = serve("hello.txt", "If-None-Match: \"x\", " + etag + "\r\n");
+  TEST_ASSERT_TRUE(res.starts_with("HTTP/1.1 304 Not Modified\r\n"));
+  TEST_ASSERT_EQUAL_STRING("", header(res, "Content-Length").c_str());
+  TEST_ASSERT_EQUAL_STRING("", body(res).c_str());
+
+  res = serve("hello.txt", "If-Modified-Since: " + last_modified + "\r\n");
+  TEST_ASSERT_TRUE(res.starts_with("HTTP/1.1 304 Not Modified\r\n"));
+  res = serve("hello.txt", "If-None-Match: \"stale\"\r\nIf-Modified-Since: " + last_modified + "\r\n");
+  TEST_ASSERT_TRUE(res.starts_with("HTTP/1.1 200 OK\r\n"));
+}
+
+void test_ranges()
+{
+  std::string res = serve("hello.txt", "Range: bytes=6-\r\n");
+  TEST_ASSERT_TRUE(res.starts_with("HTTP/1.1 206 Partial Content\r\n"));
+  TEST_ASSERT_EQUAL_STRING("bytes 6-10/11", header(res, "Content-Range").c_str());
+  TEST_ASSERT_EQUAL_STRING("world", body(res).c_str());
+
+  TEST_ASSERT_EQUAL_STRING("ld", body(serve("hello.txt", "Range: bytes=-2\r\n")).c_str());
+  TEST_ASSERT_EQUAL_STRING("hello", body(serve("hello.txt", "Range: bytes=0-4\r\n")).c_str());
+
+  res = serve("hello.txt", "Range: bytes=11-\r\n");
+  TEST_ASSERT_TRUE(res.starts_with("HTTP/1.1 416 Range Not Satisfiable\r\n"));
+  TEST_ASSERT_EQUAL_STRING("bytes */11", header(res, "Content-Range").c_str());
+
+  // several ranges, or a stale If-Range, get the whole file
+  TEST_ASSERT_EQUAL_STRING("hello world", body(serve("hello.txt", "Range: bytes=0-1,3-4\r\n")).c_str());
+  TEST_ASSERT_EQUAL_STRING("hello world", body(serve("hello.txt", "Range: bytes=0-1\r\nIf-Range: \"stale\"\r\n")).c_str());
+}
+
+void test_precompressed_sibling()
+{
+  std::string res = serve("hello.txt", "Accept-Encoding: br;q=0, gzip\r\n");
+  TEST_ASSERT_EQUAL_STRING("gzip", header(res, "Content-Encoding").c_str());
+  TEST_ASSERT_EQUAL_STRING("text/plain; charset=utf-8", header(res, "Content-Type").c_str());
+  TEST_ASSERT_EQUAL_STRING("gzipped", body(res).c_str());
+  TEST_ASSERT_EQUAL_STRING("", header(serve("hello.txt", "Accept-Encoding: br\r\n"), "Content-Encoding").c_str());
+}
+
+void test_missing_file()
+{
+  TEST_ASSERT_TRUE(serve("nothing.txt").starts_with("HTTP/1.1 404 Not Found\r\n"));
+}
+
+static void write_file(const std::filesystem::path &path, const char *content)
+{
+  FILE *f = fopen(path.c_str(), "w");
+  fputs(content, f);
+  fclose(f);
+}
+
+int main()
+{
+  dir = std::filesystem::temp_directory_path() / "falcon_test_static";
+  std::filesystem::create_directories(dir);
+  write_file(dir / "hello.txt", "hello world");
+  // not a real gzip stream, only its presence matters
+  write_file(dir / "hello.txt.gz", "gzipped");
+
+  UNITY_BEGIN();
+  RUN_TEST(test_whole_file_with_validators);
+  RUN_TEST(test_conditional_get_is_not_modified);
+  RUN_TEST(test_ranges);
+  RUN_TEST(test_precompressed_sibling);
+  RUN_TEST(test_missing_file);
+  int failures = UNITY_END();
+  std::filesystem::remove_all(dir);
+  return failures;
+}
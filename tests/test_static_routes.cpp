@@ -0,0 +1,75 @@
+#include <cstring>
+#include <optional>
+#include <string>
+
+#include <unity.h>
+
+#include "fixture.hpp"
+#include "include/fc.hpp"
+
+static fc::response find_by_id(fc::request &req) { return fc::response::json({{"id", req.get_param("id").value()}}); }
+static fc::response find_post(fc::request &req)
+{
+  return fc::response::json({{"id", req.get_param("id").value()}, {"post", req.get_param("post").value()}});
+}
+static fc::response files(fc::request &req) { return fc::response::ok(fc::status::ACCEPTED); }
+static fc::response create(fc::request &req) { return fc::response::ok(fc::status::CREATED); }
+
+using table = fc::routes<fc::get<"/users/:id", find_by_id>, fc::get<"/users/:id/posts/:post", find_post>, fc::get<"/files/*", files>, fc::post<"/users", create>>;
+
+static_assert(fc::get<"/users/:id/posts/:post", find_post>::m_nsegments == 4);
+static_assert(fc::get<"/users/:id/posts/:post", find_post>::m_nparams == 2);
+static_assert(fc::get<"//users//:id/", find_by_id>::m_segments[1] == ":id");
+
+// parses 'raw' and runs it through the table, the status is 0 when no route matched
+static int dispatch(const char *raw, std::string *body = nullptr)
+{
+  fc::request req = parse_request(raw);
+  std::optional<fc::response> res;
+  if (!table::dispatch(req, res)) return 0;
+  const std::string &out = res->to_string();
+  if (body) *body = out.substr(out.find("\r\n\r\n") + 4);
+  return std::stoi(out.substr(strlen("HTTP/1.1 "), 3));
+}
+
+void setUp(void)
+{
+  // set stuff up here
+}
+
+void tearDown(void)
+{
+  // clean stuff up here
+}
+
+void test_dynamic_segments_are_extracted()
+{
+  std::string body;
+  TEST_ASSERT_EQUAL_INT(200, dispatch("GET /users/42/posts/7?draft=1 HTTP/1.1\r\n\r\n", &body));
+  TEST_ASSERT_EQUAL_STRING("{\"id\":\"42\",\"post\":\"7\"}", body.c_str());
+  TEST_ASSERT_EQUAL_INT(200, dispatch("GET //users/42/ HTTP/1.1\r\n\r\n", &body));
+  TEST_ASSERT_EQUAL_STRING("{\"id\":\"42\"}", body.c_str());
+}
+
+void test_method_and_length_must_match()
+{
+  TEST_ASSERT_EQUAL_INT(201, dispatch("POST /users HTTP/1.1\r\nContent-Length: 0\r\n\r\n"));
+  TEST_ASSERT_EQUAL_INT(0, dispatch("GET /users HTTP/1.1\r\n\r\n"));
+  TEST_ASSERT_EQUAL_INT(0, dispatch("DELETE /users/42 HTTP/1.1\r\n\r\n"));
+  TEST_ASSERT_EQUAL_INT(0, dispatch("GET /users/42/posts HTTP/1.1\r\n\r\n"));
+}
+
+void test_wildcard_swallows_the_rest()
+{
+  TEST_ASSERT_EQUAL_INT(202, dispatch("GET /files/a/b/c.txt HTTP/1.1\r\n\r\n"));
+  TEST_ASSERT_EQUAL_INT(0, dispatch("GET /files HTTP/1.1\r\n\r\n"));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_dynamic_segments_are_extracted);
+  RUN_TEST(test_method_and_length_must_match);
+  RUN_TEST(test_wildcard_swallows_the_rest);
+  return UNITY_END();
+}
@@ -0,0 +1,184 @@
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include <unity.h>
+
+#include "server.hpp"
+#include "src/stream.hpp"
+
+// stopped in 'tearDown', a failed assertion leaves the test function without unwinding it
+static std::unique_ptr<test_server> server;
+
+// stream kept by 'park' for the test thread to write to
+static std::mutex parked_mutex;
+static std::optional<fc::body_stream> parked;
+
+// 'bulk' writes this much, as fast as the stream takes it
+static const size_t BULK_SIZE = 8 * 1024 * 1024;
+static std::atomic<unsigned> bulk_pulls{0};
+
+static fc::response hello(fc::request &req)
+{
+  return fc::response::stream(req, [](fc::body_stream &stream) {
+    stream.write("hello");
+    stream.write("");
+    stream.write(", world");
+    stream.end();
+  });
+}
+
+static fc::response park(fc::request &req)
+{
+  return fc::response::stream(req, [](fc::body_stream &stream) {
+    std::lock_guard<std::mutex> lock(parked_mutex);
+    parked.emplace(stream);
+  });
+}
+
+static fc::response bulk(fc::request &req)
+{
+  auto written = std::make_shared<size_t>(0);
+  return fc::response::stream(req, [written](fc::body_stream &stream) {
+    bulk_pulls++;
+    while (stream.ready() && *written < BULK_SIZE) {
+      stream.write(std::string(16 * 1024, 'a' + (*written / (16 * 1024)) % 26));
+      *written += 16 * 1024;
+    }
+    if (*written == BULK_SIZE) stream.end();
+  });
+}
+
+static fc::response echo(fc::request &req) { return fc::response::json(req.get_param("name").value()); }
+
+static void start()
+{
+  server = std::make_unique<test_server>();
+  server->m_router.add(fc::method::GET, "/hello", hello, {});
+  server->m_router.add(fc::method::GET, "/park", park, {});
+  server->m_router.add(fc::method::GET, "/bulk", bulk, {});
+  server->m_router.add(fc::method::GET, "/echo/:name", echo, {});
+  server->start();
+}
+
+// the stream parked by the loop thread, once it is
+static fc::body_stream take_parked()
+{
+  TEST_ASSERT_TRUE(eventually([] {
+    std::lock_guard<std::mutex> lock(parked_mutex);
+    return parked.has_value();
+  }));
+  std::lock_guard<std::mutex> lock(parked_mutex);
+  fc::body_stream stream = *parked;
+  parked.reset();
+  return stream;
+}
+
+void setUp(void)
+{
+  bulk_pulls = 0;
+}
+
+void tearDown(void)
+{
+  parked.reset();
+  server.reset();
+}
+
+void test_chunk_framing()
+{
+  start();
+  test_client client(server->m_port);
+  client.send("GET /hello HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n");
+  std::string raw = client.read_raw();
+  TEST_ASSERT_TRUE(raw.find("Transfer-Encoding: chunked\r\n") != std::string::npos);
+  TEST_ASSERT_TRUE(raw.find("Content-Length") == std::string::npos);
+  // an empty write sends nothing, an empty chunk would end the body
+  std::string body = raw.substr(raw.find("\r\n\r\n") + 4);
+  TEST_ASSERT_EQUAL_STRING("5\r\nhello\r\n7\r\n, world\r\n0\r\n\r\n", body.c_str());
+}
+
+void test_http_1_0_body_ends_with_the_connection()
+{
+  start();
+  test_client client(server->m_port);
+  client.send("GET /hello HTTP/1.0\r\nConnection: keep-alive\r\n\r\n");
+  std::string raw = client.read_raw();
+  TEST_ASSERT_TRUE(raw.find("Transfer-Encoding") == std::string::npos);
+  TEST_ASSERT_EQUAL_STRING("hello, world", raw.substr(raw.find("\r\n\r\n") + 4).c_str());
+}
+
+void test_pipelined_request_behind_a_stream()
+{
+  start();
+  test_client client(server->m_port);
+  client.send("GET /hello HTTP/1.1\r\nHost: x\r\n\r\nGET /echo/a HTTP/1.1\r\nHost: x\r\n\r\n");
+  test_response res = client.read();
+  TEST_ASSERT_TRUE(res.m_chunked);
+  TEST_ASSERT_EQUAL_STRING("hello, world", res.m_body.c_str());
+  TEST_ASSERT_EQUAL_STRING("\"a\"", client.read().m_body.c_str());
+  // and again behind a stream written from another thread
+  client.send("GET /park HTTP/1.1\r\nHost: x\r\n\r\nGET /echo/b HTTP/1.1\r\nHost: x\r\n\r\n");
+  fc::body_stream stream = take_parked();
+  TEST_ASSERT_TRUE(stream.write("from elsewhere"));
+  stream.end();
+  TEST_ASSERT_FALSE(stream.write("too late"));
+  TEST_ASSERT_EQUAL_STRING("from elsewhere", client.read().m_body.c_str());
+  TEST_ASSERT_EQUAL_STRING("\"b\"", client.read().m_body.c_str());
+}
+
+void test_ready_follows_the_queue()
+{
+  start();
+  test_client client(server->m_port);
+  client.send("GET /park HTTP/1.1\r\nHost: x\r\n\r\n");
+  fc::body_stream stream = take_parked();
+  TEST_ASSERT_TRUE(stream.ready());
+  // queued until the socket took it, past the high-water mark
+  TEST_ASSERT_TRUE(stream.write(std::string(FC_STREAM_HIGH_WATER, 'x')));
+  TEST_ASSERT_FALSE(stream.ready());
+  TEST_ASSERT_TRUE(eventually([&] { return stream.ready(); }));
+  stream.end();
+  TEST_ASSERT_EQUAL(FC_STREAM_HIGH_WATER, client.read().m_body.size());
+}
+
+void test_producer_pulled_again_once_drained()
+{
+  start();
+  test_client client(server->m_port);
+  client.send("GET /bulk HTTP/1.1\r\nHost: x\r\n\r\n");
+  test_response res = client.read();
+  TEST_ASSERT_EQUAL(BULK_SIZE, res.m_body.size());
+  TEST_ASSERT_TRUE(res.m_body.compare(16 * 1024 * 27, 3, "bbb") == 0);
+  // it stopped on 'ready' each time the queue filled up
+  TEST_ASSERT_TRUE(bulk_pulls.load() > 1);
+}
+
+void test_write_refused_once_the_client_left()
+{
+  start();
+  test_client client(server->m_port);
+  client.send("GET /park HTTP/1.1\r\nHost: x\r\n\r\n");
+  fc::body_stream stream = take_parked();
+  TEST_ASSERT_TRUE(stream.write("first"));
+  client.close();
+  // the loop finds out from a failed write, any write after that is refused
+  std::string chunk(16 * 1024, 'x');
+  TEST_ASSERT_TRUE(eventually([&] { return !stream.write(chunk); }));
+  TEST_ASSERT_FALSE(stream.ready());
+  TEST_ASSERT_TRUE(eventually([] { return 1 == server->m_worker->m_stats.m_closed.load(); }));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_chunk_framing);
+  RUN_TEST(test_http_1_0_body_ends_with_the_connection);
+  RUN_TEST(test_pipelined_request_behind_a_stream);
+  RUN_TEST(test_ready_follows_the_queue);
+  RUN_TEST(test_producer_pulled_again_once_drained);
+  RUN_TEST(test_write_refused_once_the_client_left);
+  return UNITY_END();
+}
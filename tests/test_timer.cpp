@@ -0,0 +1,102 @@
+#include <vector>
+
+#include <unity.h>
+
+#include "src/timer.hpp"
+
+static std::vector<fc::timer_entry *> fired;
+
+// ticks 'n' times, recording what expired
+static void advance(fc::timer_wheel &wheel, unsigned n)
+{
+  for (unsigned i = 0; i < n; i++) wheel.tick([](fc::timer_entry *entry, fc::timeout) { fired.push_back(entry); });
+}
+
+void setUp(void)
+{
+  // set stuff up here
+}
+
+void tearDown(void)
+{
+  fired.clear();
+}
+
+void test_entries_expire_after_their_ticks()
+{
+  fc::timer_wheel wheel;
+  fc::timer_entry a, b;
+  wheel.schedule(&a, fc::timeout::IDLE, 3);
+  wheel.schedule(&b, fc::timeout::HEADER, 5);
+  TEST_ASSERT_EQUAL(2, wheel.m_size);
+  advance(wheel, 3);
+  TEST_ASSERT_EQUAL(0, fired.size());
+  advance(wheel, 1);
+  TEST_ASSERT_EQUAL(1, fired.size());
+  TEST_ASSERT_TRUE(fired[0] == &a);
+  TEST_ASSERT_TRUE(a.m_kind == fc::timeout::NONE);
+  TEST_ASSERT_NULL(a.m_prev);
+  advance(wheel, 2);
+  TEST_ASSERT_EQUAL(2, fired.size());
+  TEST_ASSERT_TRUE(fired[1] == &b);
+  TEST_ASSERT_EQUAL(0, wheel.m_size);
+}
+
+void test_rescheduling_and_cancelling()
+{
+  fc::timer_wheel wheel;
+  fc::timer_entry a, b;
+  wheel.schedule(&a, fc::timeout::HEADER, 2);
+  wheel.schedule(&b, fc::timeout::BODY, 2);
+  advance(wheel, 1);
+  // moved further away, scheduled twice it is still linked once
+  wheel.schedule(&a, fc::timeout::WRITE, 4);
+  wheel.cancel(&b);
+  wheel.cancel(&b);
+  TEST_ASSERT_EQUAL(1, wheel.m_size);
+  advance(wheel, 4);
+  TEST_ASSERT_EQUAL(0, fired.size());
+  advance(wheel, 1);
+  TEST_ASSERT_EQUAL(1, fired.size());
+  TEST_ASSERT_TRUE(fired[0] == &a);
+}
+
+void test_deadlines_past_one_revolution()
+{
+  fc::timer_wheel wheel;
+  fc::timer_entry a;
+  wheel.schedule(&a, fc::timeout::IDLE, FC_TIMER_SLOTS * 2 + 10);
+  // its slot comes around twice before its round
+  advance(wheel, FC_TIMER_SLOTS * 2 + 10);
+  TEST_ASSERT_EQUAL(0, fired.size());
+  advance(wheel, 1);
+  TEST_ASSERT_EQUAL(1, fired.size());
+}
+
+void test_expired_entries_can_be_scheduled_again()
+{
+  fc::timer_wheel wheel;
+  fc::timer_entry a;
+  wheel.schedule(&a, fc::timeout::BODY, 0);
+  unsigned expirations = 0;
+  for (int i = 0; i < 10; i++) {
+    wheel.tick([&](fc::timer_entry *entry, fc::timeout kind) {
+      TEST_ASSERT_TRUE(kind == fc::timeout::BODY);
+      expirations++;
+      // lands in the slot being walked, it must not expire twice in one tick
+      wheel.schedule(entry, kind, FC_TIMER_SLOTS - 1);
+    });
+  }
+  TEST_ASSERT_EQUAL(1, expirations);
+  TEST_ASSERT_EQUAL(1, wheel.m_size);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_entries_expire_after_their_ticks);
+  RUN_TEST(test_rescheduling_and_cancelling);
+  RUN_TEST(test_deadlines_past_one_revolution);
+  RUN_TEST(test_expired_entries_can_be_scheduled_again);
+  return UNITY_END();
+}